@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/***********************************************************************
+ * Standalone benchmark for block call latency.
+ *
+ * Usage: GrPothosBenchDirectCall [--duration=seconds] > results.json
+ *
+ * Setters and getters on a generated block are called through the
+ * registered callables and through the generated direct call thunks,
+ * toggled with the block's setDirectCalls(). Calls are made on the
+ * block itself, as done for slots, and through a block proxy.
+ **********************************************************************/
+
+#include <Pothos/Init.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Proxy.hpp>
+
+#include <json.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Benchmark harness
+ **********************************************************************/
+static double minDuration = 0.5; //seconds per case
+
+//sink for results so the calls cannot be optimized out
+static volatile size_t sink = 0;
+
+static double runCase(const std::function<void(void)> &fcn)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    //warm up any caches and lazy initialization
+    for (size_t i = 0; i < 16; i++) fcn();
+
+    size_t iterations = 0;
+    size_t batch = 1;
+    const auto t0 = clock::now();
+    double elapsed = 0.0;
+
+    //double the batch size until the minimum duration is reached
+    while (elapsed < minDuration)
+    {
+        for (size_t i = 0; i < batch; i++) fcn();
+        iterations += batch;
+        batch *= 2;
+        elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    }
+
+    return 1e9*elapsed/iterations;
+}
+
+//time the call with direct calls disabled and enabled
+static json compareCase(const std::string &name, const std::shared_ptr<Pothos::Block> &block, const std::function<void(void)> &fcn)
+{
+    block->call("setDirectCalls", false);
+    const auto callableNs = runCase(fcn);
+    block->call("setDirectCalls", true);
+    const auto directNs = runCase(fcn);
+
+    json result;
+    result["name"] = name;
+    result["callable_ns_per_call"] = callableNs;
+    result["direct_ns_per_call"] = directNs;
+    result["speedup"] = callableNs/directNs;
+    std::cerr << "  " << name << ": " << callableNs << " ns -> " << directNs << " ns" << std::endl;
+    return result;
+}
+
+/***********************************************************************
+ * main
+ **********************************************************************/
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg.find("--duration=") == 0) minDuration = std::stod(arg.substr(11));
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--duration=seconds]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Pothos::init();
+
+    //call the factory directly for the block rather than a proxy
+    const auto factory = Pothos::PluginRegistry::get("/blocks/gr/blocks/add_const").getObject().extract<Pothos::Callable>();
+    const auto block = factory.call<std::shared_ptr<Pothos::Block>>(std::string("add_const_ff"), 0.0f);
+    const auto env = Pothos::ProxyEnvironment::make("managed");
+    const auto proxy = env->makeProxy(block);
+
+    json results = json::array();
+    results.push_back(compareCase("set_k", block, [&block]()
+    {
+        block->call("set_k", 1.0f);
+    }));
+    results.push_back(compareCase("set_k_convert_double", block, [&block]()
+    {
+        block->call("set_k", 1.0);
+    }));
+    results.push_back(compareCase("k", block, [&block]()
+    {
+        sink += size_t(block->call<float>("k"));
+    }));
+    results.push_back(compareCase("proxy_set_k", block, [&proxy]()
+    {
+        proxy.call("set_k", 1.0f);
+    }));
+
+    json topObject;
+    topObject["benchmark"] = "direct_call";
+    topObject["block"] = "/gr/blocks/add_const(add_const_ff)";
+    topObject["min_duration"] = minDuration;
+    topObject["results"] = results;
+    std::cout << topObject.dump(4) << std::endl;
+
+    return EXIT_SUCCESS;
+}
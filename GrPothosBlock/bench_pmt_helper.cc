@@ -0,0 +1,309 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/***********************************************************************
+ * Standalone benchmark for the Object <-> pmt_t conversions.
+ *
+ * Usage: GrPothosBenchPmtHelper [--duration=seconds] > results.json
+ *
+ * Every case reports conversions per second along with the number
+ * of heap allocations and bytes allocated per conversion, as JSON.
+ * Allocations are counted by replacing the global operator new,
+ * which is why this is an executable and not a module self-test.
+ **********************************************************************/
+
+#include "pothos_support.h"
+#include <Pothos/Object/Containers.hpp>
+#include <Pothos/Framework/BufferChunk.hpp>
+#include <Pothos/Framework/Label.hpp>
+#include <Pothos/Framework/Packet.hpp>
+
+#include <gnuradio/constants.h>
+#include <gnuradio/tags.h>
+
+#include <json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Allocation accounting
+ **********************************************************************/
+static std::atomic<unsigned long long> numAllocs(0);
+static std::atomic<unsigned long long> numBytes(0);
+
+void *operator new(std::size_t size)
+{
+    numAllocs++;
+    numBytes += size;
+    if (void *p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+/***********************************************************************
+ * Benchmark harness
+ **********************************************************************/
+static double minDuration = 0.5; //seconds per case
+
+//sink for results so the conversions cannot be optimized out
+static volatile size_t sink = 0;
+
+//conversionsPerCall normalizes batch cases to per-conversion figures
+static json runCase(const std::string &name, const std::string &direction, const std::function<void(void)> &fcn, const size_t conversionsPerCall = 1)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    //warm up any caches and lazy initialization
+    for (size_t i = 0; i < 16; i++) fcn();
+
+    size_t iterations = 0;
+    size_t batch = 1;
+    const auto allocs0 = numAllocs.load();
+    const auto bytes0 = numBytes.load();
+    const auto t0 = clock::now();
+    double elapsed = 0.0;
+
+    //double the batch size until the minimum duration is reached
+    while (elapsed < minDuration)
+    {
+        for (size_t i = 0; i < batch; i++) fcn();
+        iterations += batch;
+        batch *= 2;
+        elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    }
+
+    const auto allocs = numAllocs.load() - allocs0;
+    const auto bytes = numBytes.load() - bytes0;
+    iterations *= conversionsPerCall;
+
+    json result;
+    result["name"] = name;
+    result["direction"] = direction;
+    result["iterations"] = iterations;
+    result["seconds"] = elapsed;
+    result["conversions_per_second"] = iterations/elapsed;
+    result["allocations_per_conversion"] = double(allocs)/iterations;
+    result["bytes_allocated_per_conversion"] = double(bytes)/iterations;
+    std::cerr << "  " << name << " (" << direction << "): " << size_t(iterations/elapsed) << " conv/s" << std::endl;
+    return result;
+}
+
+//benchmark both conversion directions for a single object
+static void benchObject(json &results, const std::string &name, const Pothos::Object &obj)
+{
+    results.push_back(runCase(name, "obj_to_pmt", [&obj]()
+    {
+        sink += size_t(obj_to_pmt(obj).get() != nullptr);
+    }));
+
+    const auto p = obj_to_pmt(obj);
+    results.push_back(runCase(name, "pmt_to_obj", [&p]()
+    {
+        sink += size_t(bool(pmt_to_obj(p)));
+    }));
+}
+
+/***********************************************************************
+ * Test data
+ **********************************************************************/
+template <typename T>
+static Pothos::Object makeNumericVector(const size_t size)
+{
+    std::vector<T> vec(size);
+    for (size_t i = 0; i < size; i++) vec[i] = T(i % 100);
+    return Pothos::Object(vec);
+}
+
+static Pothos::Object makeNestedDict(const size_t numKeys, const size_t depth)
+{
+    Pothos::ObjectMap m;
+    for (size_t i = 0; i < numKeys; i++)
+    {
+        const auto key = Pothos::Object("key" + std::to_string(i));
+        if (depth > 1) m[key] = makeNestedDict(numKeys, depth-1);
+        else if (i % 3 == 0) m[key] = Pothos::Object(int32_t(i));
+        else if (i % 3 == 1) m[key] = Pothos::Object(double(i)/7);
+        else m[key] = Pothos::Object("value" + std::to_string(i));
+    }
+    return Pothos::Object(m);
+}
+
+static Pothos::Object makePacket(const size_t numBytes)
+{
+    Pothos::Packet packet;
+    packet.payload = Pothos::BufferChunk(typeid(unsigned char), numBytes);
+    for (size_t i = 0; i < numBytes; i++) packet.payload.as<unsigned char *>()[i] = i;
+    packet.metadata["packet_len"] = Pothos::Object(int32_t(numBytes));
+    packet.metadata["rx_time"] = Pothos::Object(uint64_t(123456789));
+    packet.metadata["freq"] = Pothos::Object(2.4e9);
+    packet.metadata["modulation"] = Pothos::Object("QPSK");
+    return Pothos::Object(packet);
+}
+
+/***********************************************************************
+ * The label translation performed by GrPothosBlock::work()
+ **********************************************************************/
+static void benchLabelRoundTrip(json &results, const std::string &name, const Pothos::Label &label)
+{
+    const uint64_t totalElements = 1000;
+
+    results.push_back(runCase(name, "label_to_tag", [&label, totalElements]()
+    {
+        gr::tag_t tag;
+        tag.key = pmt::string_to_symbol(label.id);
+        tag.value = obj_to_pmt(label.data);
+        tag.offset = label.index + totalElements;
+        sink += size_t(tag.offset);
+    }));
+
+    gr::tag_t tag;
+    tag.key = pmt::string_to_symbol(label.id);
+    tag.value = obj_to_pmt(label.data);
+    tag.offset = label.index + totalElements;
+
+    results.push_back(runCase(name, "tag_to_label", [&tag, totalElements]()
+    {
+        Pothos::Label out;
+        out.id = pmt::symbol_to_string(tag.key);
+        out.data = pmt_to_obj(tag.value);
+        out.index = tag.offset - totalElements;
+        sink += size_t(out.index);
+    }));
+
+    results.push_back(runCase(name, "label_round_trip", [&label, totalElements]()
+    {
+        gr::tag_t tag;
+        tag.key = pmt::string_to_symbol(label.id);
+        tag.value = obj_to_pmt(label.data);
+        tag.offset = label.index + totalElements;
+
+        Pothos::Label out;
+        out.id = pmt::symbol_to_string(tag.key);
+        out.data = pmt_to_obj(tag.value);
+        out.index = tag.offset - totalElements;
+        sink += size_t(out.index);
+    }));
+}
+
+//the batch API with the per-thread arena, as used by GrPothosBlock::work()
+static void benchLabelBatch(json &results, const std::string &name, const Pothos::Label &label)
+{
+    const uint64_t totalElements = 1000;
+    const std::vector<Pothos::Label> labels(16, label);
+    std::vector<gr::tag_t> tags;
+    std::vector<Pothos::Label> outLabels;
+
+    std::multimap<uint64_t, gr::tag_t> tagMap;
+    results.push_back(runCase(name, "label_batch_round_trip", [&]()
+    {
+        labels_to_tags(labels.data(), labels.data()+labels.size(), totalElements, tags);
+        tagMap.clear();
+        for (const auto &tag : tags) tagMap.emplace(tag.offset, tag);
+        tags_to_labels(tagMap.begin(), tagMap.end(), totalElements, outLabels);
+        sink += outLabels.size();
+    }, labels.size()));
+}
+
+/***********************************************************************
+ * main
+ **********************************************************************/
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg.find("--duration=") == 0) minDuration = std::stod(arg.substr(11));
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--duration=seconds]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    json results = json::array();
+
+    std::cerr << "Scalars..." << std::endl;
+    benchObject(results, "bool", Pothos::Object(true));
+    benchObject(results, "int32", Pothos::Object(int32_t(-12345)));
+    benchObject(results, "uint64", Pothos::Object(uint64_t(1234567890123ULL)));
+    benchObject(results, "double", Pothos::Object(3.14159));
+    benchObject(results, "complex_float64", Pothos::Object(std::complex<double>(1.0, -1.0)));
+
+    std::cerr << "Strings..." << std::endl;
+    benchObject(results, "string_short", Pothos::Object(std::string("rx_time")));
+    benchObject(results, "string_long", Pothos::Object(std::string(256, 'x')));
+
+    std::cerr << "Numeric vectors..." << std::endl;
+    benchObject(results, "vector_float32_1k", makeNumericVector<float>(1024));
+    benchObject(results, "vector_float32_64k", makeNumericVector<float>(65536));
+    benchObject(results, "vector_complex_float32_64k", makeNumericVector<std::complex<float>>(65536));
+    benchObject(results, "vector_uint16_64k", makeNumericVector<uint16_t>(65536));
+
+    std::cerr << "Containers..." << std::endl;
+    benchObject(results, "object_vector_64", Pothos::Object(Pothos::ObjectVector(64, Pothos::Object(int32_t(42)))));
+    benchObject(results, "dict_flat_16", makeNestedDict(16, 1));
+    benchObject(results, "dict_nested_8x3", makeNestedDict(8, 3));
+
+    std::cerr << "PDUs..." << std::endl;
+    for (const size_t size : {64, 1500, 9000, 65536})
+    {
+        benchObject(results, "pdu_" + std::to_string(size), makePacket(size));
+    }
+
+    std::cerr << "Labels..." << std::endl;
+    benchLabelRoundTrip(results, "label_uint64", Pothos::Label("rx_time", uint64_t(123456789), 10));
+    benchLabelRoundTrip(results, "label_string", Pothos::Label("modulation", std::string("QPSK"), 10));
+    benchLabelRoundTrip(results, "label_bool", Pothos::Label("burst", true, 10));
+    benchLabelRoundTrip(results, "label_dict", Pothos::Label("meta", makeNestedDict(4, 1), 10));
+    benchLabelBatch(results, "label_uint64", Pothos::Label("rx_time", uint64_t(123456789), 10));
+    benchLabelBatch(results, "label_string", Pothos::Label("modulation", std::string("QPSK"), 10));
+    benchLabelBatch(results, "label_bool", Pothos::Label("burst", true, 10));
+
+    json topObject;
+    topObject["benchmark"] = "pmt_helper";
+    topObject["gnuradio_version"] = gr::version();
+    topObject["min_duration"] = minDuration;
+    topObject["results"] = results;
+    std::cout << topObject.dump(4) << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/***********************************************************************
+ * Standalone benchmark for module load and registration time.
+ *
+ * Usage: GrPothosBenchStartup [--blocks] [--top=N] <--init | module or directory...> > results.json
+ *
+ * Every module is loaded in order and timed, directories are searched
+ * recursively for modules. With --init, the time for Pothos::init()
+ * to load every installed module is reported instead. The two are
+ * exclusive, since modules loaded by Pothos::init() cannot be timed
+ * again. Compare the results with and without GR_POTHOS_LAZY_REGISTRATION.
+ *
+ * With --blocks, every block registered under /gr is then created
+ * from the defaults in its block description and timed. Blocks whose
+ * defaults cannot be evaluated standalone are reported with an error.
+ * The converters in the GrPothosBlock module are needed to make the
+ * blocks, so either pass --init or list that module first.
+ *
+ * The N slowest modules and blocks are summarized at the top level.
+ **********************************************************************/
+
+#include <Pothos/Init.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Util/EvalEnvironment.hpp>
+
+#include "pothos_block_docs.h"
+
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <Poco/SharedLibrary.h>
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+using Clock = std::chrono::high_resolution_clock;
+
+static double secondsSince(const Clock::time_point &t0)
+{
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+//number of plugins in the registry at and below the path
+static size_t countPlugins(const Pothos::PluginPath &path)
+{
+    size_t count = 0;
+    for (const auto &name : Pothos::PluginRegistry::list(path))
+    {
+        const auto subPath = path.join(name);
+        if (Pothos::PluginRegistry::exists(subPath)) count++;
+        count += countPlugins(subPath);
+    }
+    return count;
+}
+
+//every block path registered at and below the path
+static void listBlocks(const Pothos::PluginPath &path, std::vector<std::string> &blocks)
+{
+    for (const auto &name : Pothos::PluginRegistry::list(path))
+    {
+        const auto subPath = path.join(name);
+        if (Pothos::PluginRegistry::exists(subPath)) blocks.push_back(subPath.toString().substr(7));
+        listBlocks(subPath, blocks);
+    }
+}
+
+static void findModules(const std::string &path, std::vector<std::string> &modules)
+{
+    const Poco::File file(path);
+    if (not file.isDirectory())
+    {
+        modules.push_back(path);
+        return;
+    }
+
+    std::vector<Poco::File> children;
+    file.list(children);
+    std::sort(children.begin(), children.end(),
+        [](const Poco::File &a, const Poco::File &b){return a.path() < b.path();});
+    for (const auto &child : children)
+    {
+        if (child.isDirectory()) findModules(child.path(), modules);
+        else if (Poco::Path(child.path()).getExtension() == Poco::SharedLibrary::suffix().substr(1))
+        {
+            modules.push_back(child.path());
+        }
+    }
+}
+
+/***********************************************************************
+ * Block instantiation from documented defaults
+ **********************************************************************/
+static Pothos::Object evalParamDefault(Pothos::Util::EvalEnvironment &evalEnv, const json &param)
+{
+    //enumerations without a default take the first option
+    std::string expr;
+    if (param.count("default")) expr = param["default"].get<std::string>();
+    else if (param.count("options") and not param["options"].empty())
+    {
+        expr = param["options"][0]["value"].get<std::string>();
+    }
+    else throw Pothos::InvalidArgumentException("no default", param.value("key", ""));
+    return evalEnv.eval(expr);
+}
+
+static json makeBlock(Pothos::Util::EvalEnvironment &evalEnv, const std::string &path)
+{
+    json result;
+    result["block"] = path;
+    try
+    {
+        //the description is a string or a reference into the docs store
+        const auto desc = json::parse(getGrPothosBlockDoc(path));
+
+        std::vector<Pothos::Object> args;
+        for (const auto &arg : desc.value("args", json::array()))
+        {
+            const auto key = arg.get<std::string>();
+            const auto params = desc.value("params", json::array());
+            const auto it = std::find_if(params.begin(), params.end(),
+                [&key](const json &param){return param.value("key", "") == key;});
+            if (it == params.end()) throw Pothos::InvalidArgumentException("no param for arg", key);
+            args.push_back(evalParamDefault(evalEnv, *it));
+        }
+
+        const auto factory = Pothos::PluginRegistry::get("/blocks"+path).getObject().extract<Pothos::Callable>();
+        const auto t0 = Clock::now();
+        const auto block = factory.opaqueCall(args.data(), args.size());
+        result["make_seconds"] = secondsSince(t0);
+        std::cerr << "  " << path << ": " << result["make_seconds"] << " s" << std::endl;
+    }
+    catch (const Pothos::Exception &ex)
+    {
+        result["error"] = ex.displayText();
+    }
+    catch (const std::exception &ex)
+    {
+        result["error"] = ex.what();
+    }
+    return result;
+}
+
+//the N slowest entries that have the timing key
+static json slowest(const json &results, const std::string &key, const size_t top)
+{
+    std::vector<json> timed;
+    for (const auto &result : results)
+    {
+        if (result.count(key)) timed.push_back(result);
+    }
+    std::sort(timed.begin(), timed.end(),
+        [&key](const json &a, const json &b){return a[key].get<double>() > b[key].get<double>();});
+    if (timed.size() > top) timed.resize(top);
+    return json(timed);
+}
+
+/***********************************************************************
+ * main
+ **********************************************************************/
+int main(int argc, char **argv)
+{
+    bool doInit = false;
+    bool doBlocks = false;
+    bool badArgs = false;
+    size_t numPaths = 0;
+    size_t top = 10;
+    std::vector<std::string> modules;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--init") doInit = true;
+        else if (arg == "--blocks") doBlocks = true;
+        else if (arg.find("--top=") == 0) top = std::stoul(arg.substr(6));
+        else if (arg.find("--") == 0) badArgs = true;
+        else
+        {
+            findModules(arg, modules);
+            numPaths++;
+        }
+    }
+
+    //init loads every installed module, so it cannot be combined with a module list
+    if (badArgs or (doInit and numPaths != 0) or (not doInit and numPaths == 0))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--blocks] [--top=N] <--init | module or directory...>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    json topObject;
+    topObject["benchmark"] = "startup";
+
+    if (doInit)
+    {
+        const auto t0 = Clock::now();
+        Pothos::init();
+        topObject["init_seconds"] = secondsSince(t0);
+        std::cerr << "Pothos::init(): " << topObject["init_seconds"] << " s" << std::endl;
+    }
+
+    //keep the modules loaded until all results are in
+    std::vector<Pothos::PluginModule> loaded;
+    json results = json::array();
+    double totalSeconds = 0.0;
+    for (const auto &path : modules)
+    {
+        const auto blocksBefore = countPlugins("/blocks");
+        const auto t0 = Clock::now();
+        json result;
+        result["module"] = path;
+        try
+        {
+            loaded.emplace_back(path);
+            result["load_seconds"] = secondsSince(t0);
+        }
+        catch (const Pothos::Exception &ex)
+        {
+            result["error"] = ex.displayText();
+            results.push_back(result);
+            continue;
+        }
+        totalSeconds += result["load_seconds"].get<double>();
+        result["blocks_registered"] = countPlugins("/blocks") - blocksBefore;
+        std::cerr << "  " << path << ": " << result["load_seconds"] << " s" << std::endl;
+        results.push_back(result);
+    }
+
+    topObject["total_load_seconds"] = totalSeconds;
+    topObject["slowest_modules"] = slowest(results, "load_seconds", top);
+    topObject["results"] = results;
+
+    if (doBlocks)
+    {
+        std::vector<std::string> blocks;
+        listBlocks("/blocks/gr", blocks);
+
+        Pothos::Util::EvalEnvironment evalEnv;
+        json blockResults = json::array();
+        double totalMakeSeconds = 0.0;
+        size_t numErrors = 0;
+        for (const auto &path : blocks)
+        {
+            const auto result = makeBlock(evalEnv, path);
+            if (result.count("make_seconds")) totalMakeSeconds += result["make_seconds"].get<double>();
+            else numErrors++;
+            blockResults.push_back(result);
+        }
+
+        topObject["total_make_seconds"] = totalMakeSeconds;
+        topObject["blocks_failed"] = numErrors;
+        topObject["slowest_blocks"] = slowest(blockResults, "make_seconds", top);
+        topObject["block_results"] = blockResults;
+    }
+
+    std::cout << topObject.dump(4) << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -32,10 +32,17 @@ class GrPothosBlock;
 #include <gnuradio/logger.h>
 #include "block_executor.h" //local copy of stock executor, missing from gr install
 #include "pothos_support.h" //misc utility functions
+#include "pothos_block_factory.h"
+#include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 /***********************************************************************
  * GrPothosBlock interfaces a gr::basic_block to the Pothos framework
@@ -45,15 +52,32 @@ class GrPothosBlock : public Pothos::Block
 public:
     static Pothos::Block *make(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType& overrideDType)
     {
-        return new GrPothosBlock(block, vlen, overrideDType);
+        return new GrPothosBlock(block, vlen, overrideDType, {}, {});
     }
 
-    GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType& overrideDType);
+    static Pothos::Block *makeGenerated(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType& overrideDType,
+        const std::vector<Pothos::DType> &inputDTypes, const std::vector<Pothos::DType> &outputDTypes,
+        void *directSelf, const GrPothosDirectCalls *directCalls)
+    {
+        auto pothosBlock = new GrPothosBlock(block, vlen, overrideDType, inputDTypes, outputDTypes);
+        pothosBlock->setupDirectCalls(directSelf, directCalls);
+        return pothosBlock;
+    }
+
+    GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType& overrideDType,
+        const std::vector<Pothos::DType> &inputDTypes, const std::vector<Pothos::DType> &outputDTypes);
     ~GrPothosBlock(void);
     void __setNumInputs(size_t);
     void __setNumOutputs(size_t);
     void __setInputAlias(const std::string &, const std::string &);
     void __setOutputAlias(const std::string &, const std::string &);
+    void setLazyMessages(const bool lazy);
+    void setMessageBatchSize(const size_t size);
+    void setMessageBatchLatency(const double seconds);
+    void setDirectCalls(const bool enable);
+    Pothos::ObjectKwargs stateSnapshot(void);
+    void setStateInterval(const double seconds);
+    Pothos::Object opaqueCallHandler(const std::string &name, const Pothos::Object *inputArgs, const size_t numArgs);
     void activate(void);
     void deactivate(void);
     void work(void);
@@ -62,6 +86,24 @@ public:
     Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &name, const std::string &domain);
 
 private:
+    void setupDirectCalls(void *directSelf, const GrPothosDirectCalls *directCalls);
+    void emitStateSnapshot(void);
+    Pothos::Object msgToObj(const pmt::pmt_t &msg) const;
+    void handleInputMessage(const pmt::pmt_t &port_id, const pmt::pmt_t &msg);
+    void postOutputMessages(void);
+    bool nextDeadline(std::chrono::high_resolution_clock::time_point &deadline) const;
+    void waitDeadlines(const bool progress);
+    bool workStreams(void);
+
+    typedef std::chrono::high_resolution_clock BatchClock;
+    struct PendingBatch
+    {
+        std::vector<pmt::pmt_t> messages;
+        BatchClock::time_point start;
+    };
+    void flushMessageBatch(Pothos::OutputPort *port, PendingBatch &batch);
+    void flushMessageBatches(void);
+
     boost::shared_ptr<gr::block> d_msg_accept_block;
     boost::shared_ptr<gr::block> d_block;
     gr::block_executor *d_exec;
@@ -69,13 +111,55 @@ private:
     gr_vector_int d_ninput_items_required;
     std::map<pmt::pmt_t, Pothos::InputPort *> d_in_msg_ports;
     std::map<pmt::pmt_t, Pothos::OutputPort *> d_out_msg_ports;
+    bool d_lazy_messages;
+    size_t d_msg_batch_size;
+    BatchClock::duration d_msg_batch_latency;
+    std::map<pmt::pmt_t, PendingBatch> d_msg_batches;
+
+    //generated thunks that call methods on the block directly
+    void *d_direct_self;
+    const GrPothosDirectCalls *d_direct_calls;
+    bool d_direct_calls_enabled;
+    std::vector<std::string> d_state_getters;
+    std::chrono::high_resolution_clock::duration d_state_interval;
+    std::chrono::high_resolution_clock::time_point d_state_next;
+
+    //scratch space for label <-> tag conversions, reused across work()
+    std::vector<gr::tag_t> d_tags_scratch;
+    std::vector<Pothos::Label> d_labels_scratch;
 };
 
+/***********************************************************************
+ * port data types
+ *
+ * The element types resolved by the generator are used when their size
+ * agrees with the io signature, the last type repeats for extra ports.
+ * Otherwise the type is inferred from the item size and block name.
+ **********************************************************************/
+static Pothos::DType portDType(const std::vector<Pothos::DType> &dtypes, const size_t index, const size_t bytes,
+    const std::string &name, const bool isInput, const size_t vlen)
+{
+    if (not dtypes.empty())
+    {
+        const auto &elem = dtypes[std::min(index, dtypes.size()-1)];
+        if (elem.size()*vlen == bytes) return Pothos::DType::fromDType(elem, vlen);
+    }
+    return inferDType(bytes, name, isInput, vlen);
+}
+
 /***********************************************************************
  * init the name and ports -- called by the block constructor
  **********************************************************************/
-GrPothosBlock::GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType& overrideDType):
-    d_block(block)
+GrPothosBlock::GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType& overrideDType,
+    const std::vector<Pothos::DType> &inputDTypes, const std::vector<Pothos::DType> &outputDTypes):
+    d_block(block),
+    d_lazy_messages(false),
+    d_msg_batch_size(0),
+    d_msg_batch_latency(0),
+    d_direct_self(nullptr),
+    d_direct_calls(nullptr),
+    d_direct_calls_enabled(true),
+    d_state_interval(0)
 {
     Pothos::Block::setName(d_block->name());
 
@@ -88,7 +172,7 @@ GrPothosBlock::GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, co
         else
         {
             auto bytes = d_input_signature->sizeof_stream_item(i);
-            Pothos::Block::setupInput(i, inferDType(bytes, d_block->name(), true, vlen));
+            Pothos::Block::setupInput(i, portDType(inputDTypes, i, bytes, d_block->name(), true, vlen));
         }
     }
 
@@ -101,7 +185,7 @@ GrPothosBlock::GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, co
         else
         {
             auto bytes = d_output_signature->sizeof_stream_item(i);
-            Pothos::Block::setupOutput(i, inferDType(bytes, d_block->name(), false, vlen));
+            Pothos::Block::setupOutput(i, portDType(outputDTypes, i, bytes, d_block->name(), false, vlen));
         }
     }
 
@@ -132,6 +216,11 @@ GrPothosBlock::GrPothosBlock(boost::shared_ptr<gr::block> block, size_t vlen, co
     Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, __setNumOutputs));
     Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, __setInputAlias));
     Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, __setOutputAlias));
+    Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, setLazyMessages));
+    Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, setMessageBatchSize));
+    Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, setMessageBatchLatency));
+    Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, setDirectCalls));
+    Pothos::Block::registerCall(this, POTHOS_FCN_TUPLE(GrPothosBlock, setStateInterval));
 }
 
 GrPothosBlock::~GrPothosBlock(void)
@@ -177,6 +266,236 @@ void GrPothosBlock::__setOutputAlias(const std::string &name, const std::string
     this->output(name)->setAlias(alias);
 }
 
+/***********************************************************************
+ * Lazy output messages: post the pmt_t wrapped in a LazyPMT.
+ * When the consumer is another wrapped block, obj_to_pmt() unwraps it
+ * and the message is never converted. Native consumers must convert
+ * the Object to the expected type, so this is opt-in per block.
+ **********************************************************************/
+void GrPothosBlock::setLazyMessages(const bool lazy)
+{
+    d_lazy_messages = lazy;
+}
+
+/***********************************************************************
+ * Direct calls: the generated factories provide a thunk per method
+ * that unboxes the arguments with the known types and calls into the
+ * block. Calls with a matching thunk and argument count skip the
+ * Callable dispatch, everything else goes to the registered calls.
+ * Direct calls can be disabled for comparison with the Callable path.
+ **********************************************************************/
+void GrPothosBlock::setDirectCalls(const bool enable)
+{
+    d_direct_calls_enabled = enable;
+}
+
+Pothos::Object GrPothosBlock::opaqueCallHandler(const std::string &name, const Pothos::Object *inputArgs, const size_t numArgs)
+{
+    if (d_direct_calls != nullptr and d_direct_calls_enabled)
+    {
+        const auto it = d_direct_calls->find(name);
+        if (it != d_direct_calls->end() and it->second.numArgs == numArgs)
+        {
+            return it->second.call(d_direct_self, inputArgs);
+        }
+    }
+
+    //state is an alias for the snapshot unless the block registered its own
+    if (name == "state" and numArgs == 0 and not d_state_getters.empty())
+    {
+        try
+        {
+            return Pothos::Block::opaqueCallHandler(name, inputArgs, numArgs);
+        }
+        catch (const Pothos::BlockCallNotFound &)
+        {
+            return Pothos::Object(this->stateSnapshot());
+        }
+    }
+    return Pothos::Block::opaqueCallHandler(name, inputArgs, numArgs);
+}
+
+void GrPothosBlock::setupDirectCalls(void *directSelf, const GrPothosDirectCalls *directCalls)
+{
+    d_direct_self = directSelf;
+    d_direct_calls = directCalls;
+
+    for (const auto &pair : *d_direct_calls)
+    {
+        if (pair.second.getter) d_state_getters.push_back(pair.first);
+    }
+    if (d_state_getters.empty()) return;
+    std::sort(d_state_getters.begin(), d_state_getters.end());
+
+    //the block methods are registered after this, so state is resolved at call time
+    Pothos::Block::registerCall(this, "block_state", &GrPothosBlock::stateSnapshot);
+    Pothos::Block::registerProbe("block_state", "block_state_triggered", "probe_block_state");
+    Pothos::Block::registerSignal("state_snapshot");
+}
+
+/***********************************************************************
+ * State snapshot: the values of all getters from a single call.
+ * Getters that throw are left out of the snapshot. It is registered
+ * as block_state, and calls to state reach it when the block has no
+ * registered method of that name, including overloads without a thunk.
+ * With an interval set, the snapshot is emitted on the state_snapshot
+ * signal once per interval. The next emit is a work deadline like a
+ * pending message batch, so an idle block still reports its state.
+ **********************************************************************/
+Pothos::ObjectKwargs GrPothosBlock::stateSnapshot(void)
+{
+    Pothos::ObjectKwargs state;
+    for (const auto &name : d_state_getters)
+    {
+        try
+        {
+            state[name] = d_direct_calls->at(name).call(d_direct_self, nullptr);
+        }
+        catch (const std::exception &) {}
+    }
+    return state;
+}
+
+void GrPothosBlock::setStateInterval(const double seconds)
+{
+    d_state_interval = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(seconds));
+    d_state_next = std::chrono::high_resolution_clock::now();
+}
+
+void GrPothosBlock::emitStateSnapshot(void)
+{
+    if (d_state_interval.count() <= 0 or d_state_getters.empty()) return;
+    const auto now = std::chrono::high_resolution_clock::now();
+    if (now < d_state_next) return;
+    d_state_next = now + d_state_interval;
+    Pothos::Block::emitSignal("state_snapshot", this->stateSnapshot());
+}
+
+Pothos::Object GrPothosBlock::msgToObj(const pmt::pmt_t &msg) const
+{
+    if (d_lazy_messages) return Pothos::Object(LazyPMT(msg));
+    return pmt_to_obj(msg);
+}
+
+/***********************************************************************
+ * Message batching: output messages are grouped into a MessageBatch
+ * of up to the batch size (0 or 1 disables batching). Messages are
+ * held for at most the batch latency, the default of 0 posts the
+ * messages produced by each call to work() as a single batch.
+ * An idle block with a partial batch sleeps until the latency expires,
+ * at most the work timeout per call, so it never spins on the batch.
+ * A wrapped consumer unbatches on its input.
+ **********************************************************************/
+void GrPothosBlock::setMessageBatchSize(const size_t size)
+{
+    //pending batches were formed under the old size, post them now
+    if (size != d_msg_batch_size) this->flushMessageBatches();
+    d_msg_batch_size = size;
+}
+
+void GrPothosBlock::setMessageBatchLatency(const double seconds)
+{
+    if (seconds < 0.0) throw Pothos::InvalidArgumentException(
+        "GrPothosBlock::setMessageBatchLatency()", "latency must be non-negative");
+    d_msg_batch_latency = std::chrono::duration_cast<BatchClock::duration>(
+        std::chrono::duration<double>(seconds));
+}
+
+void GrPothosBlock::flushMessageBatch(Pothos::OutputPort *port, PendingBatch &batch)
+{
+    if (batch.messages.size() == 1) port->postMessage(this->msgToObj(batch.messages.front()));
+    else if (not batch.messages.empty())
+    {
+        MessageBatch msgs;
+        msgs.messages.swap(batch.messages);
+        port->postMessage(Pothos::Object(std::move(msgs)));
+    }
+    batch.messages.clear();
+}
+
+void GrPothosBlock::flushMessageBatches(void)
+{
+    for (auto &pair : d_msg_batches)
+    {
+        this->flushMessageBatch(d_out_msg_ports.at(pair.first), pair.second);
+    }
+    d_msg_batches.clear();
+}
+
+void GrPothosBlock::handleInputMessage(const pmt::pmt_t &port_id, const pmt::pmt_t &msg)
+{
+    auto handler = d_block->d_msg_handlers[port_id];
+    if (handler) handler(msg);
+    else d_block->_post(port_id, msg);
+}
+
+void GrPothosBlock::postOutputMessages(void)
+{
+    pmt::pmt_t msg;
+    for (const auto &pair : d_out_msg_ports)
+    {
+        if (d_msg_batch_size <= 1)
+        {
+            while ((msg = d_msg_accept_block->delete_head_nowait(pair.first)))
+            {
+                pair.second->postMessage(this->msgToObj(msg));
+            }
+            continue;
+        }
+
+        auto &batch = d_msg_batches[pair.first];
+        while ((msg = d_msg_accept_block->delete_head_nowait(pair.first)))
+        {
+            if (batch.messages.empty()) batch.start = BatchClock::now();
+            batch.messages.push_back(msg);
+            if (batch.messages.size() >= d_msg_batch_size) this->flushMessageBatch(pair.second, batch);
+        }
+
+        if (batch.messages.empty()) continue;
+        if (BatchClock::now() - batch.start >= d_msg_batch_latency) this->flushMessageBatch(pair.second, batch);
+    }
+}
+
+//the earliest of the pending batch and state snapshot deadlines
+bool GrPothosBlock::nextDeadline(BatchClock::time_point &deadline) const
+{
+    bool pending = false;
+    for (const auto &pair : d_msg_batches)
+    {
+        if (pair.second.messages.empty()) continue;
+        const auto expires = pair.second.start + d_msg_batch_latency;
+        if (not pending or expires < deadline) deadline = expires;
+        pending = true;
+    }
+    if (d_state_interval.count() > 0 and not d_state_getters.empty())
+    {
+        if (not pending or d_state_next < deadline) deadline = d_state_next;
+        pending = true;
+    }
+    return pending;
+}
+
+void GrPothosBlock::waitDeadlines(const bool progress)
+{
+    BatchClock::time_point deadline;
+    if (not this->nextDeadline(deadline)) return;
+
+    //a block that made progress will be called again soon,
+    //otherwise sleep towards the deadline within the work timeout
+    if (not progress)
+    {
+        const auto timeout = std::chrono::duration_cast<BatchClock::duration>(
+            std::chrono::nanoseconds(Pothos::Block::workInfo().maxTimeoutNs));
+        const auto now = BatchClock::now();
+        if (deadline > now) std::this_thread::sleep_for(std::min(deadline - now, timeout));
+        this->postOutputMessages();
+        this->emitStateSnapshot();
+    }
+
+    //come back for the deadlines that are still pending
+    if (this->nextDeadline(deadline)) this->yield();
+}
+
 /***********************************************************************
  * activation/deactivate notification events
  **********************************************************************/
@@ -222,6 +541,9 @@ void GrPothosBlock::activate(void)
 
 void GrPothosBlock::deactivate(void)
 {
+    //post messages still held for batching
+    this->flushMessageBatches();
+
     //unsubscribe the dummy message acceptor block
     pmt::pmt_t msg_ports_out = d_block->message_ports_out();
     for (size_t i = 0; i < pmt::length(msg_ports_out); i++)
@@ -241,32 +563,38 @@ void GrPothosBlock::deactivate(void)
  **********************************************************************/
 void GrPothosBlock::work(void)
 {
-    pmt::pmt_t msg;
-
     //forward messages into the queues
     for (const auto &pair : d_in_msg_ports)
     {
         while (pair.second->hasMessage())
         {
-            msg = obj_to_pmt(pair.second->popMessage());
-            auto handler = d_block->d_msg_handlers[pair.first];
-            if (handler) handler(msg);
-            else d_block->_post(pair.first, msg);
+            const auto obj = pair.second->popMessage();
+            if (obj.type() == typeid(MessageBatch))
+            {
+                for (const auto &msg : obj.extract<MessageBatch>().messages)
+                {
+                    this->handleInputMessage(pair.first, msg);
+                }
+            }
+            else this->handleInputMessage(pair.first, obj_to_pmt(obj));
         }
     }
 
-    //propagate output messages produced thus far
-    //used by the message only blocks that wont continue work
-    for (const auto &pair : d_out_msg_ports)
-    {
-        while ((msg = d_msg_accept_block->delete_head_nowait(pair.first)))
-        {
-            pair.second->postMessage(pmt_to_obj(msg));
-        }
-    }
+    //state snapshot when the interval has elapsed
+    this->emitStateSnapshot();
 
+    //call into the block when the streams allow it
+    const bool progress = this->workStreams();
+
+    //propagate output messages produced from work
+    this->postOutputMessages();
+    this->waitDeadlines(progress);
+}
+
+bool GrPothosBlock::workStreams(void)
+{
     //no streaming ports, there is nothing to do in the logic below
-    if (d_detail->noutputs() == 0 and d_detail->ninputs() == 0) return;
+    if (d_detail->noutputs() == 0 and d_detail->ninputs() == 0) return false;
 
     //re-apply reserve in-case it changed (low cost setter)
     size_t reserve = d_block->history();
@@ -288,9 +616,9 @@ void GrPothosBlock::work(void)
 
     //check that input and output items meets the reserve req
     const auto &workInfo = Pothos::Block::workInfo();
-    if (workInfo.minInElements < reserve) return;
-    if (workInfo.minOutElements == 0) return;
-    if (d_block->fixed_rate() and int(workInfo.minOutElements) < d_block->fixed_rate_ninput_to_noutput(reserve)) return;
+    if (workInfo.minInElements < reserve) return false;
+    if (workInfo.minOutElements == 0) return false;
+    if (d_block->fixed_rate() and int(workInfo.minOutElements) < d_block->fixed_rate_ninput_to_noutput(reserve)) return false;
 
     //force buffer to look at current port's resources
     for (auto port : this->inputs())
@@ -305,16 +633,11 @@ void GrPothosBlock::work(void)
         reader->d_abs_read_offset = port->totalElements();
 
         //move input labels into the input buffer's tags
+        labels_to_tags(port->labels().begin(), port->labels().end(), port->totalElements(), d_tags_scratch);
+        for (const auto &tag : d_tags_scratch) buff->add_item_tag(tag);
         while (port->labels().begin() != port->labels().end())
         {
-            const auto &label = *port->labels().begin();
-            auto offset = label.index + port->totalElements();
-            gr::tag_t tag;
-            tag.key = pmt::string_to_symbol(label.id);
-            tag.value = obj_to_pmt(label.data);
-            tag.offset = offset;
-            buff->add_item_tag(tag);
-            port->removeLabel(label);
+            port->removeLabel(*port->labels().begin());
         }
     }
 
@@ -332,9 +655,11 @@ void GrPothosBlock::work(void)
     d_exec->run_one_iteration();
 
     //search the detail input buffer for consume
+    bool progress = false;
     for (auto port : this->inputs())
     {
         const auto nread = d_detail->nitems_read(port->index());
+        if (nread != port->totalElements()) progress = true;
         port->consume(nread-port->totalElements());
     }
 
@@ -342,33 +667,19 @@ void GrPothosBlock::work(void)
     for (auto port : this->outputs())
     {
         const auto nwritten = d_detail->nitems_written(port->index());
+        if (nwritten != port->totalElements()) progress = true;
         port->produce(nwritten-port->totalElements());
 
         //post output labels from output buffer's tags
         const auto buff = d_detail->output(port->index());
-        for (auto it = buff->get_tags_begin(); it != buff->get_tags_end(); it++)
-        {
-            const auto &tag = it->second;
-            Pothos::Label label;
-            label.id = pmt::symbol_to_string(tag.key);
-            label.data = pmt_to_obj(tag.value);
-            assert(tag.offset >= port->totalElements());
-            label.index = tag.offset - port->totalElements();
-            port->postLabel(label);
-        }
+        tags_to_labels(buff->get_tags_begin(), buff->get_tags_end(), port->totalElements(), d_labels_scratch);
+        for (auto &label : d_labels_scratch) port->postLabel(std::move(label));
 
         //remove all tags once posted
         buff->d_item_tags.clear();
     }
 
-    //propagate output messages produced from work
-    for (const auto &pair : d_out_msg_ports)
-    {
-        while ((msg = d_msg_accept_block->delete_head_nowait(pair.first)))
-        {
-            pair.second->postMessage(pmt_to_obj(msg));
-        }
-    }
+    return progress;
 }
 
 /***********************************************************************
@@ -407,6 +718,12 @@ Pothos::BufferManager::Sptr GrPothosBlock::getOutputBufferManager(const std::str
 static Pothos::BlockRegistry registerGrPothosBlock(
     "/gnuradio/block", &GrPothosBlock::make);
 
+pothos_static_block(registerGrPothosBlockFactory)
+{
+    const GrPothosBlockFactory factory(&GrPothosBlock::makeGenerated);
+    Pothos::PluginRegistry::add(GR_POTHOS_BLOCK_FACTORY_PATH, Pothos::Object(factory));
+}
+
 /***********************************************************************
  * All of GNU Radio's block loggers descend from either "gr_log" or
  * "gr_debug", so add our appender here to catch any messages that are
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2014-2017 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "pothos_block_docs.h"
+#include <Pothos/Callable.hpp>
+#include <Pothos/Testing.hpp>
+#include <Poco/DeflatingStream.h>
+#include <Poco/TemporaryFile.h>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+/***********************************************************************
+ * On-demand block descriptions convert to the JSON string
+ **********************************************************************/
+static std::string blockDocRefToString(const GrPothosBlockDocRef &ref)
+{
+    return ref.str();
+}
+
+pothos_static_block(registerGrPothosBlockDocRef)
+{
+    Pothos::PluginRegistry::add("/object/convert/gr/block_doc_ref_to_string", Pothos::Callable(&blockDocRefToString));
+}
+
+/***********************************************************************
+ * Read back a store written in the GrPothosUtil.py layout
+ **********************************************************************/
+static void writeU32(std::ostream &out, const uint32_t v)
+{
+    const unsigned char b[4] = {
+        static_cast<unsigned char>(v), static_cast<unsigned char>(v >> 8),
+        static_cast<unsigned char>(v >> 16), static_cast<unsigned char>(v >> 24)};
+    out.write(reinterpret_cast<const char *>(b), sizeof(b));
+}
+
+static std::string compress(const std::string &raw)
+{
+    std::ostringstream out;
+    Poco::DeflatingOutputStream deflater(out, Poco::DeflatingStreamBuf::STREAM_ZLIB);
+    deflater << raw;
+    deflater.close();
+    return out.str();
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_block_docs_store)
+{
+    const std::vector<std::pair<std::string, std::string>> entries{
+        {"/gr/test/foo", "{\"path\": \"/gr/test/foo\"}"},
+        {"/gr/test/bar", "{\"path\": \"/gr/test/bar\", \"docs\": []}"}};
+
+    std::ostringstream store;
+    store.write("GRPDOC02", 8);
+    writeU32(store, entries.size());
+    uint32_t offset = 12+20*entries.size();
+    std::vector<std::string> compressed;
+    for (const auto &entry : entries)
+    {
+        compressed.push_back(compress(entry.second));
+        writeU32(store, offset);
+        writeU32(store, entry.first.size());
+        writeU32(store, offset+entry.first.size());
+        writeU32(store, compressed.back().size());
+        writeU32(store, entry.second.size());
+        offset += entry.first.size()+compressed.back().size();
+    }
+    for (size_t i = 0; i < entries.size(); i++) store << entries[i].first << compressed[i];
+    const auto bytes = store.str();
+
+    //the installed file and the store in memory read back the same
+    Poco::TemporaryFile tempFile;
+    {
+        std::ofstream out(tempFile.path().c_str(), std::ios::binary);
+        out << bytes;
+    }
+    const auto mapped = std::make_shared<const GrPothosBlockDocs>(tempFile.path());
+    const auto inMemory = std::make_shared<const GrPothosBlockDocs>(bytes.data(), bytes.size());
+    for (const auto &docs : {mapped, inMemory})
+    {
+        POTHOS_TEST_EQUAL(docs->size(), entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            POTHOS_TEST_EQUAL(docs->path(i), entries[i].first);
+            POTHOS_TEST_EQUAL(docs->doc(i), entries[i].second);
+        }
+    }
+
+    //references convert and read through the registry helper
+    const Pothos::Object ref(GrPothosBlockDocRef{inMemory, 1});
+    POTHOS_TEST_EQUAL(ref.convert<std::string>(), entries[1].second);
+    Pothos::PluginRegistry::add("/blocks/docs"+entries[1].first, ref);
+    POTHOS_TEST_EQUAL(getGrPothosBlockDoc(entries[1].first), entries[1].second);
+    Pothos::PluginRegistry::remove("/blocks/docs"+entries[1].first);
+
+    //a corrupt store is rejected rather than read out of bounds
+    POTHOS_TEST_THROWS(GrPothosBlockDocs(bytes.data(), 20), Poco::DataFormatException);
+}
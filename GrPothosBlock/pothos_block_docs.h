@@ -0,0 +1,194 @@
+/*
+ * Copyright 2014-2017 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <Pothos/Object/Object.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/System.hpp>
+#include <Poco/Exception.h>
+#include <Poco/File.h>
+#include <Poco/InflatingStream.h>
+#include <Poco/Logger.h>
+#include <Poco/MemoryStream.h>
+#include <Poco/SharedMemory.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+/*!
+ * Block descriptions written by GrPothosUtil.py --docs-out.
+ * There is one file per component, installed to <data path>/gnuradio,
+ * which is memory mapped so descriptions are only paged in when read.
+ *
+ * Layout, little endian, descriptions are zlib compressed:
+ *   char magic[8] = "GRPDOC02"
+ *   uint32 count
+ *   count x {uint32 pathOffset, pathLength, docOffset, docLength, rawLength}
+ *   path and compressed description data
+ */
+class GrPothosBlockDocs
+{
+public:
+    //! Map the store file at path
+    explicit GrPothosBlockDocs(const std::string &path):
+        _map(new Poco::SharedMemory(Poco::File(path), Poco::SharedMemory::AM_READ)),
+        _begin(_map->begin()),
+        _size(size_t(_map->end()-_map->begin())),
+        _count(0)
+    {
+        this->validate(path);
+    }
+
+    //! Use a store that is already in memory, the caller keeps it alive
+    GrPothosBlockDocs(const char *data, const size_t size):
+        _begin(data),
+        _size(size),
+        _count(0)
+    {
+        this->validate("memory store");
+    }
+
+    size_t size(void) const
+    {
+        return _count;
+    }
+
+    //! The block path for entry i, ex: /gr/blocks/copy
+    std::string path(const size_t i) const
+    {
+        return std::string(_begin+this->u32(this->entry(i)+0), this->u32(this->entry(i)+4));
+    }
+
+    //! The JSON block description for entry i
+    std::string doc(const size_t i) const
+    {
+        const auto e = this->entry(i);
+        Poco::MemoryInputStream compressed(_begin+this->u32(e+8), this->u32(e+12));
+        Poco::InflatingInputStream inflater(compressed, Poco::InflatingStreamBuf::STREAM_ZLIB);
+        std::string out(this->u32(e+16), '\0');
+        inflater.read(&out[0], out.size());
+        if (size_t(inflater.gcount()) != out.size())
+        {
+            throw Poco::DataFormatException("GrPothosBlockDocs", this->path(i)+" truncated description");
+        }
+        return out;
+    }
+
+private:
+    static size_t entry(const size_t i)
+    {
+        return 12+20*i;
+    }
+
+    void validate(const std::string &what)
+    {
+        if (_size < 12 or std::memcmp(_begin, "GRPDOC02", 8) != 0)
+        {
+            throw Poco::DataFormatException("GrPothosBlockDocs", what+" bad header");
+        }
+        _count = this->u32(8);
+        if (this->entry(_count) > _size)
+        {
+            throw Poco::DataFormatException("GrPothosBlockDocs", what+" truncated index");
+        }
+        for (size_t i = 0; i < _count; i++)
+        {
+            const auto e = this->entry(i);
+            if (uint64_t(this->u32(e+0))+this->u32(e+4) > _size or
+                uint64_t(this->u32(e+8))+this->u32(e+12) > _size)
+            {
+                throw Poco::DataFormatException("GrPothosBlockDocs", what+" entry out of bounds");
+            }
+        }
+    }
+
+    uint32_t u32(const size_t offset) const
+    {
+        const auto p = reinterpret_cast<const unsigned char *>(_begin+offset);
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    std::unique_ptr<Poco::SharedMemory> _map;
+    const char *_begin;
+    size_t _size;
+    size_t _count;
+};
+
+/*!
+ * A block description that is read from the store on demand.
+ * Only registered when GR_POTHOS_DOCS_LAZY=1, see below.
+ * The GrPothosBlock module registers a converter to std::string,
+ * so consumers read these with convert<std::string>(),
+ * or with getGrPothosBlockDoc() below.
+ */
+struct GrPothosBlockDocRef
+{
+    std::shared_ptr<const GrPothosBlockDocs> docs;
+    size_t index;
+
+    std::string str(void) const
+    {
+        return docs->doc(index);
+    }
+};
+
+//! The JSON description registered at /blocks/docs<path>, either representation
+inline std::string getGrPothosBlockDoc(const std::string &path)
+{
+    const auto obj = Pothos::PluginRegistry::get("/blocks/docs"+path).getObject();
+    if (obj.type() == typeid(GrPothosBlockDocRef)) return obj.extract<GrPothosBlockDocRef>().str();
+    return obj.convert<std::string>();
+}
+
+/*!
+ * Register /blocks/docs/<path> for every description of a component,
+ * read from the installed store. The descriptions are registered as
+ * strings, which is what /blocks/docs consumers extract(). Set
+ * GR_POTHOS_DOCS_LAZY=1 to register GrPothosBlockDocRef objects instead,
+ * which decompress on conversion, for tools that only read a few.
+ * A missing or unreadable store is logged and the blocks still register,
+ * just without descriptions.
+ */
+inline void registerGrPothosBlockDocs(const std::string &component)
+{
+    const auto path = Pothos::System::getDataPath()+"/gnuradio/"+component+"_docs.bin";
+    std::shared_ptr<const GrPothosBlockDocs> docs;
+    try
+    {
+        docs = std::make_shared<const GrPothosBlockDocs>(path);
+    }
+    catch (const Poco::Exception &ex)
+    {
+        Poco::Logger::get("GrPothosBlockDocs").warning("%s: %s, no block descriptions for %s", path, ex.displayText(), component);
+        return;
+    }
+
+    const char *lazyEnv = std::getenv("GR_POTHOS_DOCS_LAZY");
+    const bool lazy = lazyEnv != nullptr and std::string(lazyEnv) == "1";
+    for (size_t i = 0; i < docs->size(); i++)
+    {
+        const auto pluginPath = "/blocks/docs"+docs->path(i);
+        if (lazy) Pothos::PluginRegistry::add(pluginPath, Pothos::Object(GrPothosBlockDocRef{docs, i}));
+        else Pothos::PluginRegistry::add(pluginPath, docs->doc(i));
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2014-2017 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace gr { class block; }
+
+/*!
+ * A generated thunk that calls a method on the gr::block subclass.
+ * The arguments are unboxed with the method's own types and the
+ * self pointer is the block as its most derived class.
+ * Getters are zero-argument methods with a result for the state snapshot.
+ */
+struct GrPothosDirectCall
+{
+    size_t numArgs;
+    Pothos::Object (*call)(void *self, const Pothos::Object *args);
+    bool getter;
+};
+
+typedef std::unordered_map<std::string, GrPothosDirectCall> GrPothosDirectCalls;
+
+/*!
+ * Construct the GrPothosBlock adapter around a gr::block.
+ * The GrPothosBlock module registers a pointer to this factory at
+ * GR_POTHOS_BLOCK_FACTORY_PATH, so that generated modules can call it
+ * directly rather than through the block registry and proxy environment.
+ *
+ * The input and output dtypes are the port element types resolved by
+ * the generator, one per port with the last repeating for extra ports.
+ * Empty lists or types that disagree with the io signature fall back
+ * to inferDType() for that port.
+ *
+ * The direct calls are a static table of method thunks, called with
+ * the direct self pointer in place of the registered callables.
+ */
+typedef Pothos::Block *(*GrPothosBlockFactory)(boost::shared_ptr<gr::block> block, size_t vlen, const Pothos::DType &overrideDType,
+    const std::vector<Pothos::DType> &inputDTypes, const std::vector<Pothos::DType> &outputDTypes,
+    void *directSelf, const GrPothosDirectCalls *directCalls);
+
+#define GR_POTHOS_BLOCK_FACTORY_PATH "/gnuradio/block_factory"
+
+//! Lookup the factory once per module, later calls do no lookups
+inline GrPothosBlockFactory getGrPothosBlockFactory(void)
+{
+    static const auto factory = Pothos::PluginRegistry::get(GR_POTHOS_BLOCK_FACTORY_PATH).getObject().extract<GrPothosBlockFactory>();
+    return factory;
+}
+
+//! Convert a factory argument, skipping the converter lookup when the type already matches
+template <typename T>
+T convertGrPothosArg(const Pothos::Object &obj)
+{
+    if (obj.type() == typeid(T)) return obj.extract<T>();
+    return obj.convert<T>();
+}
+
+//! The decayed type of a method's argument, used by the direct call thunks
+template <typename Fcn, size_t i>
+struct GrPothosMethodArg;
+
+template <typename ClassType, typename ReturnType, typename... ArgsType, size_t i>
+struct GrPothosMethodArg<ReturnType (ClassType::*)(ArgsType...), i>
+{
+    typedef typename std::decay<typename std::tuple_element<i, std::tuple<ArgsType...>>::type>::type type;
+};
+
+template <typename ClassType, typename ReturnType, typename... ArgsType, size_t i>
+struct GrPothosMethodArg<ReturnType (ClassType::*)(ArgsType...) const, i>
+{
+    typedef typename std::decay<typename std::tuple_element<i, std::tuple<ArgsType...>>::type>::type type;
+};
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2014-2017,2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "pothos_support.h"
+#include <Pothos/Object.hpp>
+#include <cassert>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/***********************************************************************
+ * Per-thread scratch arena for label <-> tag conversions
+ *
+ * Label ids and string values are interned as pmt symbols on every
+ * work() call, and pmt::string_to_symbol() hashes into a global table
+ * under a mutex. Each worker thread keeps its own cache, so lookups
+ * need no locking, and the cached objects are reused across calls.
+ *
+ * Each cached symbol keeps its string alongside, so tag keys map back
+ * to label ids without pmt::symbol_to_string(). The cache is bounded
+ * and evicts the least recently used symbol once it is full.
+ **********************************************************************/
+static const size_t maxArenaEntries = 1024;
+
+struct ArenaSymbol
+{
+    ArenaSymbol(const std::string &id, const pmt::pmt_t &symbol):
+        id(id),
+        symbol(symbol)
+    {
+        return;
+    }
+
+    const std::string id;
+    const pmt::pmt_t symbol;
+};
+
+class ArenaSymbolCache
+{
+public:
+    //string -> symbol, interned on a miss
+    const ArenaSymbol &fromString(const std::string &s)
+    {
+        const auto it = _byString.find(s);
+        if (it != _byString.end()) return this->touch(it->second);
+        return this->insert(s, pmt::string_to_symbol(s));
+    }
+
+    //symbol -> string, converted on a miss
+    const ArenaSymbol &fromSymbol(const pmt::pmt_t &symbol)
+    {
+        const auto it = _bySymbol.find(symbol.get());
+        if (it != _bySymbol.end()) return this->touch(it->second);
+        return this->insert(pmt::symbol_to_string(symbol), symbol);
+    }
+
+private:
+    typedef std::list<ArenaSymbol> EntryList;
+
+    const ArenaSymbol &touch(const EntryList::iterator &it)
+    {
+        _entries.splice(_entries.begin(), _entries, it);
+        return *it;
+    }
+
+    const ArenaSymbol &insert(const std::string &s, const pmt::pmt_t &symbol)
+    {
+        if (_entries.size() >= maxArenaEntries)
+        {
+            const auto &oldest = _entries.back();
+            _byString.erase(oldest.id);
+            _bySymbol.erase(oldest.symbol.get());
+            _entries.pop_back();
+        }
+        _entries.emplace_front(s, symbol);
+        _byString.emplace(s, _entries.begin());
+        _bySymbol.emplace(symbol.get(), _entries.begin());
+        return _entries.front();
+    }
+
+    //most recently used at the front
+    EntryList _entries;
+    std::unordered_map<std::string, EntryList::iterator> _byString;
+    std::unordered_map<const void *, EntryList::iterator> _bySymbol;
+};
+
+struct LabelArena
+{
+    LabelArena(void):
+        trueObj(true),
+        falseObj(false)
+    {
+        return;
+    }
+
+    ArenaSymbolCache symbols;
+
+    const Pothos::Object trueObj;
+    const Pothos::Object falseObj;
+};
+
+static LabelArena &getLabelArena(void)
+{
+    static thread_local LabelArena arena;
+    return arena;
+}
+
+static const pmt::pmt_t &arenaSymbol(LabelArena &arena, const std::string &s)
+{
+    return arena.symbols.fromString(s).symbol;
+}
+
+static pmt::pmt_t arenaLabelDataToPmt(LabelArena &arena, const Pothos::Object &data)
+{
+    if (data.type() == typeid(std::string)) return arenaSymbol(arena, data.extract<std::string>());
+    return obj_to_pmt(data);
+}
+
+static Pothos::Object arenaTagValueToObj(LabelArena &arena, const pmt::pmt_t &value)
+{
+    //symbol values are interned by pmt_to_obj()
+    if (pmt::is_bool(value)) return pmt::to_bool(value)?arena.trueObj:arena.falseObj;
+    return pmt_to_obj(value);
+}
+
+/***********************************************************************
+ * Label <-> tag conversions
+ **********************************************************************/
+void label_to_tag(const Pothos::Label &label, const uint64_t offset, gr::tag_t &tag)
+{
+    auto &arena = getLabelArena();
+    tag.key = arenaSymbol(arena, label.id);
+    tag.value = arenaLabelDataToPmt(arena, label.data);
+    tag.offset = label.index + offset;
+}
+
+void tag_to_label(const gr::tag_t &tag, const uint64_t offset, Pothos::Label &label)
+{
+    auto &arena = getLabelArena();
+    label.id = arena.symbols.fromSymbol(tag.key).id;
+    label.data = arenaTagValueToObj(arena, tag.value);
+    assert(tag.offset >= offset);
+    label.index = tag.offset - offset;
+}
@@ -26,18 +26,231 @@
 #include <Pothos/Framework/Packet.hpp>
 #include <Poco/Format.h>
 #include <Poco/Types.h> //POCO_LONG_IS_64_BIT
+#include <algorithm>
 #include <cstdint>
 #include <utility>
 #include <vector>
 #include <tuple>
 #include <set>
 #include <map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
 
+/***********************************************************************
+ * Lazy conversion support
+ **********************************************************************/
+struct LazyPMT::Impl
+{
+    Impl(const pmt::pmt_t &p): pmt(p), converted(false){}
+    const pmt::pmt_t pmt;
+    std::once_flag once;
+    std::atomic<bool> converted;
+    Pothos::Object obj;
+};
+
+LazyPMT::LazyPMT(void):
+    _impl(std::make_shared<Impl>(pmt::pmt_t()))
+{
+    return;
+}
+
+LazyPMT::LazyPMT(const pmt::pmt_t &p):
+    _impl(std::make_shared<Impl>(p))
+{
+    return;
+}
+
+const pmt::pmt_t &LazyPMT::pmt(void) const
+{
+    return _impl->pmt;
+}
+
+const Pothos::Object &LazyPMT::object(void) const
+{
+    //the same message may be consumed by several blocks in parallel
+    auto &impl = *_impl;
+    std::call_once(impl.once, [&impl]
+    {
+        impl.obj = pmt_to_obj(impl.pmt);
+        impl.converted = true;
+    });
+    return impl.obj;
+}
+
+bool LazyPMT::converted(void) const
+{
+    return _impl->converted;
+}
+
+/***********************************************************************
+ * Symbol intern cache:
+ * Tag and metadata values are mostly drawn from a small set of symbols.
+ * Recently seen symbols map to a shared string Object, so converting
+ * them again does not allocate, and queued duplicates share storage.
+ * pmt never frees symbols, so the address is a stable cache key.
+ *
+ * Each thread keeps its own LRU, so lookups take no locks. A hit hands
+ * out the cached Object as is, so interned Objects must not be mutated:
+ * consumers that need to modify the string copy it with extract() first.
+ * The counters are per thread and only summed by stats().
+ **********************************************************************/
+static const size_t symbolCacheCapacity = 1024;
+static const size_t symbolCacheMaxLength = 256; //dont hold onto long strings
+
+struct SymbolCacheCounters
+{
+    SymbolCacheCounters(void):
+        hits(0), misses(0), evictions(0), bypassed(0), size(0)
+    {
+        return;
+    }
+
+    //written only by the owning thread, read by stats()
+    std::atomic<unsigned long long> hits, misses, evictions, bypassed;
+    std::atomic<size_t> size;
+};
+
+//the counters of live thread caches, and the totals of exited threads
+struct SymbolCacheRegistry
+{
+    std::mutex mutex;
+    std::set<const SymbolCacheCounters *> live;
+    unsigned long long hits = 0, misses = 0, evictions = 0, bypassed = 0;
+};
+
+static SymbolCacheRegistry &getSymbolCacheRegistry(void)
+{
+    static SymbolCacheRegistry registry;
+    return registry;
+}
+
+class SymbolInternCache
+{
+public:
+    SymbolInternCache(void)
+    {
+        auto &registry = getSymbolCacheRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.insert(&_counters);
+    }
+
+    ~SymbolInternCache(void)
+    {
+        auto &registry = getSymbolCacheRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.erase(&_counters);
+        registry.hits += _counters.hits;
+        registry.misses += _counters.misses;
+        registry.evictions += _counters.evictions;
+        registry.bypassed += _counters.bypassed;
+    }
+
+    Pothos::Object get(const pmt::pmt_t &p)
+    {
+        const auto key = p.get();
+        auto it = _index.find(key);
+        if (it != _index.end())
+        {
+            _lru.splice(_lru.begin(), _lru, it->second);
+            bump(_counters.hits);
+            return it->second->obj;
+        }
+
+        auto str = pmt::symbol_to_string(p);
+        if (str.size() > symbolCacheMaxLength)
+        {
+            bump(_counters.bypassed);
+            return Pothos::Object(std::move(str));
+        }
+
+        bump(_counters.misses);
+        if (_lru.size() >= symbolCacheCapacity)
+        {
+            bump(_counters.evictions);
+            _index.erase(_lru.back().key);
+            _lru.pop_back();
+        }
+        _lru.emplace_front(key, std::move(str));
+        _index[key] = _lru.begin();
+        _counters.size.store(_lru.size(), std::memory_order_relaxed);
+        return _lru.front().obj;
+    }
+
+    static Pothos::ObjectKwargs stats(void)
+    {
+        auto &registry = getSymbolCacheRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto hits = registry.hits, misses = registry.misses, evictions = registry.evictions;
+        auto bypassed = registry.bypassed;
+        size_t size = 0;
+        for (const auto counters : registry.live)
+        {
+            hits += counters->hits.load(std::memory_order_relaxed);
+            misses += counters->misses.load(std::memory_order_relaxed);
+            evictions += counters->evictions.load(std::memory_order_relaxed);
+            bypassed += counters->bypassed.load(std::memory_order_relaxed);
+            size = std::max(size, counters->size.load(std::memory_order_relaxed));
+        }
+
+        Pothos::ObjectKwargs stats;
+        stats["hits"] = Pothos::Object(hits);
+        stats["misses"] = Pothos::Object(misses);
+        stats["evictions"] = Pothos::Object(evictions);
+        stats["bypassed"] = Pothos::Object(bypassed);
+        stats["threads"] = Pothos::Object(registry.live.size());
+        stats["capacity"] = Pothos::Object(symbolCacheCapacity);
+        stats["size"] = Pothos::Object(size);
+        return stats;
+    }
+
+private:
+    //single writer, so a relaxed load and store avoids a locked add
+    static void bump(std::atomic<unsigned long long> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    }
+
+    struct Entry
+    {
+        Entry(const pmt::pmt_base *key, std::string &&str):
+            key(key), obj(std::move(str))
+        {
+            return;
+        }
+        const pmt::pmt_base *key;
+        const Pothos::Object obj;
+    };
+
+    typedef std::list<Entry> LruList;
+    LruList _lru;
+    std::unordered_map<const pmt::pmt_base *, LruList::iterator> _index;
+    SymbolCacheCounters _counters;
+};
+
+static SymbolInternCache &getSymbolInternCache(void)
+{
+    static thread_local SymbolInternCache cache;
+    return cache;
+}
+
+Pothos::ObjectKwargs pmt_symbol_cache_stats(void)
+{
+    return SymbolInternCache::stats();
+}
+
+/***********************************************************************
+ * Object <-> pmt_t conversions
+ **********************************************************************/
 pmt::pmt_t obj_to_pmt(const Pothos::Object &obj)
 {
     //the container is null
     if (not obj) return pmt::pmt_t();
 
+    //unconverted pmt from another wrapped block
+    if (obj.type() == typeid(LazyPMT)) return obj.extract<LazyPMT>().pmt();
+
     //Packet support
     if (obj.type() == typeid(Pothos::Packet))
     {
@@ -216,7 +429,7 @@ Pothos::Object pmt_to_obj(const pmt::pmt_t &p)
     decl_pmt_to_obj(pmt::is_bool, pmt::to_bool);
 
     //string (do object interning for strings)
-    decl_pmt_to_obj(pmt::is_symbol, pmt::symbol_to_string);
+    if (pmt::is_symbol(p)) return getSymbolInternCache().get(p);
 
     //numeric types
     //long can typedef to int64, force this to int32
@@ -338,6 +551,33 @@ static T convert_from_pmt(const pmt::pmt_t& pmt)
     return pmt_to_obj(pmt).extract<T>();
 }
 
+template <typename T>
+static T convert_from_lazy_pmt(const LazyPMT &lazy)
+{
+    return lazy.object().convert<T>();
+}
+
+template <typename T>
+static void register_lazy_converter(const std::string& name)
+{
+    Pothos::PluginRegistry::add(
+        Poco::format("/object/convert/gr/lazy_pmt_to_%s", name),
+        Pothos::Callable(&convert_from_lazy_pmt<T>));
+}
+
+static pmt::pmt_t lazy_pmt_to_pmt(const LazyPMT &lazy)
+{
+    return lazy.pmt();
+}
+
+static Pothos::ObjectVector message_batch_to_object_vector(const MessageBatch &batch)
+{
+    Pothos::ObjectVector objs;
+    objs.reserve(batch.messages.size());
+    for (const auto &msg : batch.messages) objs.push_back(pmt_to_obj(msg));
+    return objs;
+}
+
 template <typename T>
 static void register_converter_pair(const std::string& name)
 {
@@ -391,6 +631,28 @@ pothos_static_block(pothosObjectRegisterPMTSupport)
 
     // Other
     register_converter_pair<Pothos::BufferChunk>("bufferchunk");
+
+    // Lazy messages: convert to what the consumer asks for
+    Pothos::PluginRegistry::add("/object/convert/gr/lazy_pmt_to_pmt", Pothos::Callable(&lazy_pmt_to_pmt));
+    register_lazy_converter<Pothos::Packet>("packet");
+    register_lazy_converter<Pothos::BufferChunk>("bufferchunk");
+    register_lazy_converter<Pothos::ObjectVector>("object_vector");
+    register_lazy_converter<Pothos::ObjectMap>("object_map");
+    register_lazy_converter<std::string>("string");
+    register_lazy_converter<bool>("bool");
+    register_lazy_converter<int32_t>("int32");
+    register_lazy_converter<int64_t>("int64");
+    register_lazy_converter<uint64_t>("uint64");
+    register_lazy_converter<double>("double");
+    register_lazy_converter<std::complex<double>>("complex");
+    register_lazy_converter<std::vector<float>>("float_vector");
+    register_lazy_converter<std::vector<std::complex<float>>>("cfloat_vector");
+
+    // Symbol intern cache metrics
+    Pothos::PluginRegistry::addCall("/gnuradio/pmt_symbol_cache_stats", &pmt_symbol_cache_stats);
+
+    // Batched messages for native consumers
+    Pothos::PluginRegistry::add("/object/convert/gr/message_batch_to_object_vector", Pothos::Callable(&message_batch_to_object_vector));
 }
 
 /***********************************************************************
@@ -415,3 +677,44 @@ void load(Archive & ar, pmt::pmt_t &t, const unsigned int)
 
 POTHOS_SERIALIZATION_SPLIT_FREE(pmt::pmt_t)
 POTHOS_OBJECT_SERIALIZE(pmt::pmt_t)
+
+namespace Pothos { namespace serialization {
+template<class Archive>
+void save(Archive & ar, const LazyPMT &t, const unsigned int)
+{
+    ar << t.pmt();
+}
+
+template<class Archive>
+void load(Archive & ar, LazyPMT &t, const unsigned int)
+{
+    pmt::pmt_t p;
+    ar >> p;
+    t = LazyPMT(p);
+}
+}}
+
+POTHOS_SERIALIZATION_SPLIT_FREE(LazyPMT)
+POTHOS_OBJECT_SERIALIZE(LazyPMT)
+
+namespace Pothos { namespace serialization {
+template<class Archive>
+void save(Archive & ar, const MessageBatch &t, const unsigned int)
+{
+    const unsigned long long size(t.messages.size());
+    ar << size;
+    for (const auto &msg : t.messages) ar << msg;
+}
+
+template<class Archive>
+void load(Archive & ar, MessageBatch &t, const unsigned int)
+{
+    unsigned long long size(0);
+    ar >> size;
+    t.messages.resize(size);
+    for (auto &msg : t.messages) ar >> msg;
+}
+}}
+
+POTHOS_SERIALIZATION_SPLIT_FREE(MessageBatch)
+POTHOS_OBJECT_SERIALIZE(MessageBatch)
@@ -21,9 +21,15 @@
 
 #pragma once
 #include <Pothos/Object/Object.hpp>
+#include <Pothos/Object/Containers.hpp>
 #include <Pothos/Framework/DType.hpp>
+#include <Pothos/Framework/Label.hpp>
+#include <gnuradio/tags.h>
 #include <pmt/pmt.h>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 /*!
  * Conversions between Object and pmt_t types.
@@ -37,5 +43,88 @@ pmt::pmt_t obj_to_pmt(const Pothos::Object &obj);
 
 Pothos::Object pmt_to_obj(const pmt::pmt_t &pmt);
 
+/*!
+ * Metrics for the per-thread symbol intern caches used by pmt_to_obj():
+ * hits, misses, evictions, bypassed (too long to intern), threads,
+ * capacity (per thread) and size (the largest thread cache).
+ * Strings from symbols may be shared, so they must not be modified in place.
+ * Also available as the plugin call /gnuradio/pmt_symbol_cache_stats.
+ */
+Pothos::ObjectKwargs pmt_symbol_cache_stats(void);
+
+/*!
+ * A pmt_t carried inside an Object that is only converted on demand.
+ * Messages between wrapped blocks pass the pmt_t through untouched:
+ * obj_to_pmt() unwraps a LazyPMT without any conversion cost.
+ * Native consumers call Object::convert<T>() for the type they expect
+ * (Packet, ObjectMap, std::string...) or object() for the full result.
+ * Copies share the converted result, which is computed at most once.
+ */
+class LazyPMT
+{
+public:
+    LazyPMT(void);
+
+    explicit LazyPMT(const pmt::pmt_t &p);
+
+    //! The original pmt -- no conversion
+    const pmt::pmt_t &pmt(void) const;
+
+    //! The result of pmt_to_obj(), converted on first access
+    const Pothos::Object &object(void) const;
+
+    //! True once any copy has converted the pmt
+    bool converted(void) const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> _impl;
+};
+
+/*!
+ * Messages from one output port of a wrapped block posted together.
+ * Wrapped consumers unbatch on input and handle each message in order,
+ * native consumers can convert the batch to an ObjectVector.
+ */
+struct MessageBatch
+{
+    std::vector<pmt::pmt_t> messages;
+};
+
+/*!
+ * Conversions between Pothos labels and gr tags.
+ * The label index is relative to the port, the tag offset is absolute,
+ * the offset parameter is the port's total elements at the time of work.
+ * Label ids and common values are resolved through a per-thread arena
+ * that is reused across work() calls, see pothos_label_helper.cc.
+ */
+void label_to_tag(const Pothos::Label &label, const uint64_t offset, gr::tag_t &tag);
+
+void tag_to_label(const gr::tag_t &tag, const uint64_t offset, Pothos::Label &label);
+
+//! Convert a range of labels into tags, out is cleared but keeps its capacity
+template <typename LabelIter>
+void labels_to_tags(const LabelIter begin, const LabelIter end, const uint64_t offset, std::vector<gr::tag_t> &out)
+{
+    out.clear();
+    for (auto it = begin; it != end; ++it)
+    {
+        out.emplace_back();
+        label_to_tag(*it, offset, out.back());
+    }
+}
+
+//! Convert a range of tags (ex: a gr::buffer's tag map) into labels, out is cleared but keeps its capacity
+template <typename TagMapIter>
+void tags_to_labels(const TagMapIter begin, const TagMapIter end, const uint64_t offset, std::vector<Pothos::Label> &out)
+{
+    out.clear();
+    for (auto it = begin; it != end; ++it)
+    {
+        out.emplace_back();
+        tag_to_label(it->second, offset, out.back());
+    }
+}
+
 //! try our best to infer the data type given the info at hand
 Pothos::DType inferDType(const size_t ioSize, const std::string &name, const bool isInput, const size_t vlen=1);
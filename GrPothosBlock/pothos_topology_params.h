@@ -0,0 +1,85 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#pragma once
+#include <Pothos/Framework.hpp>
+#include <Pothos/Object.hpp>
+#include <Pothos/Proxy.hpp>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*!
+ * A parameter of a Pothos::Topology whose value is kept in the topology
+ * and forwarded to setters on its inner blocks.
+ *
+ * Each binding resolves the inner block pointer once and stores a
+ * compiled transform from the parameter to the setter's argument, so an
+ * update is one call per bound setter on the block, with no evaluator
+ * blocks, signals or expression parsing in between. The getter reads
+ * the stored value rather than querying an inner block.
+ */
+template <typename T>
+class GrPothosTopologyParam
+{
+public:
+    GrPothosTopologyParam(const T &value = T()):
+        d_value(value)
+    {
+        return;
+    }
+
+    const T &get(void) const
+    {
+        return d_value;
+    }
+
+    //! Forward the value to the setter unchanged
+    void bind(const Pothos::Proxy &block, const std::string &setter)
+    {
+        this->bind(block, setter, [](const T &value){return value;});
+    }
+
+    //! Forward transform(value) to the setter, starting with the current value
+    template <typename Fcn>
+    void bind(const Pothos::Proxy &block, const std::string &setter, Fcn &&transform)
+    {
+        const Pothos::Block *blockPtr = block.call<Pothos::Block *>("getPointer");
+        d_bindings.emplace_back([blockPtr, setter, transform](const T &value)
+        {
+            const Pothos::Object arg(transform(value));
+            blockPtr->opaqueCallMethod(setter, &arg, 1);
+        });
+        d_bindings.back()(d_value);
+    }
+
+    void set(const T &value)
+    {
+        d_value = value;
+        for (const auto &binding : d_bindings) binding(d_value);
+    }
+
+private:
+    T d_value;
+    std::vector<std::function<void(const T &)>> d_bindings;
+};
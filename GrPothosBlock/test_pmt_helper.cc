@@ -25,7 +25,9 @@
 #include <Pothos/Framework/Packet.hpp>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 template <typename T>
@@ -232,3 +234,93 @@ POTHOS_TEST_BLOCK("/gnuradio/tests", test_pmt_serialization)
     testPMTSerialization<std::uint64_t>(1234567890ULL);
     testPMTSerialization<std::string>("testPMTSerialization");
 }
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_label_tag_batch)
+{
+    const uint64_t totalElements = 1000;
+    std::vector<Pothos::Label> inLabels;
+    inLabels.emplace_back("rx_time", uint64_t(123456789), 0);
+    inLabels.emplace_back("modulation", std::string("QPSK"), 5);
+    inLabels.emplace_back("burst", true, 10);
+    inLabels.emplace_back("burst", false, 20);
+
+    //run twice so the second pass uses the per-thread arena
+    std::vector<gr::tag_t> tags;
+    std::vector<Pothos::Label> outLabels;
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        POTHOS_TEST_CHECKPOINT();
+        labels_to_tags(inLabels.data(), inLabels.data()+inLabels.size(), totalElements, tags);
+        POTHOS_TEST_EQUAL(tags.size(), inLabels.size());
+        for (size_t i = 0; i < tags.size(); i++)
+        {
+            POTHOS_TEST_TRUE(pmt::eq(tags[i].key, pmt::string_to_symbol(inLabels[i].id)));
+            POTHOS_TEST_EQUAL(tags[i].offset, inLabels[i].index + totalElements);
+        }
+        POTHOS_TEST_TRUE(pmt::eq(tags[1].value, pmt::string_to_symbol("QPSK")));
+
+        //tags_to_labels accepts the buffer's tag map
+        std::multimap<uint64_t, gr::tag_t> tagMap;
+        for (const auto &tag : tags) tagMap.emplace(tag.offset, tag);
+
+        POTHOS_TEST_CHECKPOINT();
+        tags_to_labels(tagMap.begin(), tagMap.end(), totalElements, outLabels);
+        POTHOS_TEST_EQUAL(outLabels.size(), inLabels.size());
+        for (size_t i = 0; i < outLabels.size(); i++)
+        {
+            POTHOS_TEST_EQUAL(outLabels[i].id, inLabels[i].id);
+            POTHOS_TEST_EQUAL(outLabels[i].index, inLabels[i].index);
+            POTHOS_TEST_TRUE(outLabels[i].data.equals(inLabels[i].data));
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_lazy_pmt)
+{
+    auto meta = pmt::make_dict();
+    meta = pmt::dict_add(meta, pmt::string_to_symbol("foo"), pmt::string_to_symbol("bar"));
+    const std::vector<uint8_t> bytes{0, 1, 2, 3, 4, 5};
+    const auto pdu = pmt::cons(meta, pmt::init_u8vector(bytes.size(), bytes.data()));
+
+    //unwrapping is free: the very same pmt comes back
+    const Pothos::Object lazy(LazyPMT(pdu));
+    POTHOS_TEST_TRUE(obj_to_pmt(lazy) == pdu);
+
+    //native consumers convert to the expected type
+    POTHOS_TEST_CHECKPOINT();
+    const auto packet = lazy.convert<Pothos::Packet>();
+    POTHOS_TEST_EQUAL(packet.payload.length, bytes.size());
+    POTHOS_TEST_EQUAL(packet.metadata.at("foo").extract<std::string>(), "bar");
+
+    //the conversion happens once and is shared by copies
+    const auto lazyCopy = lazy.extract<LazyPMT>();
+    POTHOS_TEST_EQUAL(&lazyCopy.object(), &lazy.extract<LazyPMT>().object());
+    POTHOS_TEST_EQUAL(Pothos::Object(LazyPMT(pmt::string_to_symbol("abc"))).convert<std::string>(), "abc");
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_pmt_symbol_cache)
+{
+    const auto sym = pmt::string_to_symbol("test_pmt_symbol_cache");
+    const auto before = pmt_symbol_cache_stats();
+
+    POTHOS_TEST_EQUAL(pmt_to_obj(sym).extract<std::string>(), "test_pmt_symbol_cache");
+    POTHOS_TEST_EQUAL(pmt_to_obj(sym).extract<std::string>(), "test_pmt_symbol_cache");
+
+    //the second conversion was served from the cache
+    const auto after = pmt_symbol_cache_stats();
+    POTHOS_TEST_TRUE(after.at("hits").convert<unsigned long long>() > before.at("hits").convert<unsigned long long>());
+    POTHOS_TEST_TRUE(after.at("size").convert<size_t>() <= after.at("capacity").convert<size_t>());
+
+    //long strings are converted but not held by the cache
+    const std::string longStr(1024, 'x');
+    POTHOS_TEST_EQUAL(pmt_to_obj(pmt::string_to_symbol(longStr)).extract<std::string>(), longStr);
+
+    //conversions on the same thread share the interned string
+    POTHOS_TEST_EQUAL(&pmt_to_obj(sym).extract<std::string>(), &pmt_to_obj(sym).extract<std::string>());
+    POTHOS_TEST_TRUE(pmt_symbol_cache_stats().count("repaired") == 0);
+
+    //other threads keep their own cache
+    std::string fromThread;
+    std::thread([&sym, &fromThread]{fromThread = pmt_to_obj(sym).extract<std::string>();}).join();
+    POTHOS_TEST_EQUAL(fromThread, "test_pmt_symbol_cache");
+}
@@ -19,9 +19,15 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "pothos_topology_params.h"
+#include "pothos_support.h"
+
 #include <Pothos/Testing.hpp>
 #include <Pothos/Framework.hpp>
+#include <Pothos/Object/Containers.hpp>
 #include <json.hpp>
+#include <chrono>
+#include <thread>
 
 using json = nlohmann::json;
 
@@ -67,6 +73,147 @@ POTHOS_TEST_BLOCK("/gnuradio/tests", test_copy_packets)
     collector.call("verifyTestPlan", expected);
 }
 
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_lazy_packets)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "uint8");
+    auto collector = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+    auto copy0 = Pothos::BlockRegistry::make("/gr/blocks/pdu_set", "key0", "value0");
+    auto copy1 = Pothos::BlockRegistry::make("/gr/blocks/pdu_set", "key1", "value1");
+
+    //the first copy passes its pmts to the second copy unconverted
+    copy0.call("setLazyMessages", true);
+
+    //a second consumer sees the same messages that the second copy got
+    auto lazyCollector = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+
+    //setup the topology
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, copy0, "pdus");
+    topology.connect(copy0, "pdus", copy1, "pdus");
+    topology.connect(copy0, "pdus", lazyCollector, 0);
+    topology.connect(copy1, "pdus", collector, 0);
+
+    //create a test plan for packets
+    json testPlan;
+    testPlan["enablePackets"] = true;
+    testPlan["enableLabels"] = true;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive());
+    collector.call("verifyTestPlan", expected);
+
+    //the posted objects are LazyPMTs that nothing converted on the way,
+    //copies share the conversion so the second copy did not convert either
+    const auto lazyMessages = lazyCollector.call<Pothos::ObjectVector>("getMessages");
+    POTHOS_TEST_TRUE(not lazyMessages.empty());
+    for (const auto &msg : lazyMessages)
+    {
+        POTHOS_TEST_TRUE(msg.type() == typeid(LazyPMT));
+        const auto &lazy = msg.extract<LazyPMT>();
+        POTHOS_TEST_TRUE(not lazy.converted());
+        msg.convert<Pothos::Packet>();
+        POTHOS_TEST_TRUE(lazy.converted());
+    }
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_batched_packets)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "uint8");
+    auto collector = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+    auto copy0 = Pothos::BlockRegistry::make("/gr/blocks/pdu_set", "key0", "value0");
+    auto copy1 = Pothos::BlockRegistry::make("/gr/blocks/pdu_set", "key1", "value1");
+
+    //the first copy batches its messages, the second copy unbatches them
+    copy0.call("setMessageBatchSize", 16);
+    copy0.call("setMessageBatchLatency", 0.001);
+
+    //setup the topology
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, copy0, "pdus");
+    topology.connect(copy0, "pdus", copy1, "pdus");
+    topology.connect(copy1, "pdus", collector, 0);
+
+    //create a test plan for packets
+    json testPlan;
+    testPlan["enablePackets"] = true;
+    testPlan["enableLabels"] = true;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive());
+    collector.call("verifyTestPlan", expected);
+}
+
+//the number of messages in each batch posted to the collector
+static std::vector<size_t> collectedBatchSizes(const Pothos::Proxy &collector)
+{
+    std::vector<size_t> sizes;
+    for (const auto &msg : collector.call<Pothos::ObjectVector>("getMessages"))
+    {
+        POTHOS_TEST_TRUE(msg.type() == typeid(MessageBatch));
+        sizes.push_back(msg.extract<MessageBatch>().messages.size());
+    }
+    return sizes;
+}
+
+static size_t waitForBatchedMessages(const Pothos::Proxy &collector, const size_t expected)
+{
+    size_t total = 0;
+    const auto exitTime = std::chrono::high_resolution_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::high_resolution_clock::now() < exitTime)
+    {
+        total = 0;
+        for (const auto size : collectedBatchSizes(collector)) total += size;
+        if (total >= expected) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return total;
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_message_batch_policy)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "uint8");
+    auto collector = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+    auto copy = Pothos::BlockRegistry::make("/gr/blocks/pdu_set", "key0", "value0");
+
+    //batches of 16 with a latency that outlives the packet burst
+    copy.call("setMessageBatchSize", 16);
+    copy.call("setMessageBatchLatency", 0.2);
+
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, copy, "pdus");
+    topology.connect(copy, "pdus", collector, 0);
+
+    for (size_t i = 0; i < 40; i++)
+    {
+        Pothos::Packet packet;
+        packet.payload = Pothos::BufferChunk("uint8", 8);
+        feeder.call("feedPacket", packet);
+    }
+    topology.commit();
+
+    //the size is honored and the tail is posted when the latency expires,
+    //the topology is still active so the deactivate flush cannot post it
+    POTHOS_TEST_EQUAL(40, waitForBatchedMessages(collector, 40));
+    const auto sizes = collectedBatchSizes(collector);
+    POTHOS_TEST_TRUE(sizes.size() >= 3);
+    POTHOS_TEST_EQUAL(16, sizes.front());
+    for (const auto size : sizes) POTHOS_TEST_TRUE(size >= 2 and size <= 16);
+
+    //a pending batch is posted when the batch size changes
+    copy.call("setMessageBatchLatency", 60.0);
+    for (size_t i = 0; i < 5; i++)
+    {
+        Pothos::Packet packet;
+        packet.payload = Pothos::BufferChunk("uint8", 8);
+        feeder.call("feedPacket", packet);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    POTHOS_TEST_EQUAL(40, waitForBatchedMessages(collector, 40));
+    copy.call("setMessageBatchSize", 1);
+    POTHOS_TEST_EQUAL(45, waitForBatchedMessages(collector, 45));
+    POTHOS_TEST_EQUAL(5, collectedBatchSizes(collector).back());
+}
+
 POTHOS_TEST_BLOCK("/gnuradio/tests", test_getter_probes)
 {
     constexpr float lo = 0.1;
@@ -118,3 +265,66 @@ POTHOS_TEST_BLOCK("/gnuradio/tests", test_getter_probes)
     POTHOS_TEST_EQUAL(1, lastStateCollectorMessages.size());
     POTHOS_TEST_EQUAL(initialState, lastStateCollectorMessages[0].convert<float>())
 }
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_state_snapshot)
+{
+    const float lo = 0.1f;
+    const float hi = 0.9f;
+    const float initialState = 1.0f;
+
+    auto thresholdFF = Pothos::BlockRegistry::make("/gr/blocks/threshold_ff", lo, hi, initialState);
+
+    //every getter is in the snapshot from a single call
+    const auto state = thresholdFF.call<Pothos::ObjectKwargs>("state");
+    POTHOS_TEST_EQUAL(lo, state.at("lo").convert<float>());
+    POTHOS_TEST_EQUAL(hi, state.at("hi").convert<float>());
+    POTHOS_TEST_EQUAL(initialState, state.at("last_state").convert<float>());
+
+    //setters are reflected in the next snapshot
+    thresholdFF.call("set_lo", 0.2f);
+    POTHOS_TEST_EQUAL(0.2f, thresholdFF.call<Pothos::ObjectKwargs>("state").at("lo").convert<float>());
+
+    //state is an alias for block_state when the block has no state method
+    const auto blockState = thresholdFF.call<Pothos::ObjectKwargs>("block_state");
+    POTHOS_TEST_EQUAL(0.2f, blockState.at("lo").convert<float>());
+    POTHOS_TEST_EQUAL(hi, blockState.at("hi").convert<float>());
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_state_snapshot_interval)
+{
+    auto thresholdFF = Pothos::BlockRegistry::make("/gr/blocks/threshold_ff", 0.1f, 0.9f, 1.0f);
+    auto slotToMessage = Pothos::BlockRegistry::make("/blocks/slot_to_message", "snapshot");
+    auto collector = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+
+    //nothing feeds the block, the interval alone drives the snapshots
+    thresholdFF.call("setStateInterval", 0.05);
+
+    Pothos::Topology topology;
+    topology.connect(thresholdFF, "state_snapshot", slotToMessage, "snapshot");
+    topology.connect(slotToMessage, 0, collector, 0);
+    topology.commit();
+
+    Pothos::ObjectVector messages;
+    for (size_t i = 0; i < 100 and messages.size() < 3; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        messages = collector.call<Pothos::ObjectVector>("getMessages");
+    }
+    POTHOS_TEST_TRUE(messages.size() >= 3);
+    POTHOS_TEST_EQUAL(0.9f, messages.back().convert<Pothos::ObjectKwargs>().at("hi").convert<float>());
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_topology_params)
+{
+    auto multiplyConst = Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_ff", 1.0f, size_t(1));
+
+    //binding applies the current value through the transform
+    GrPothosTopologyParam<float> gain(2.0f);
+    gain.bind(multiplyConst, "set_k", [](const float value){return value*10.0f;});
+    POTHOS_TEST_EQUAL(20.0f, multiplyConst.call<float>("k"));
+
+    //updates reach the inner block, and the getter reads the stored value
+    gain.set(3.0f);
+    POTHOS_TEST_EQUAL(3.0f, gain.get());
+    POTHOS_TEST_EQUAL(30.0f, multiplyConst.call<float>("k"));
+}
@@ -51,6 +51,48 @@ def glob_recurse(base, filt):
       for filename in fnmatch.filter(filenames, filt):
           yield os.path.join(root, filename)
 
+########################################################################
+## on-disk parse cache -- keyed by file contents and parser version
+########################################################################
+import hashlib
+import pickle
+
+#bump when the cached data or the pre-parse rewriting changes
+PARSE_CACHE_VERSION = 1
+PARSE_CACHE = dict(dir=None, hits=0, misses=0)
+
+def parse_cache_path(kind, contents, parser_version):
+    key = hashlib.sha1()
+    key.update(('%s:%s:%s:'%(kind, PARSE_CACHE_VERSION, parser_version)).encode('utf-8'))
+    key.update(contents.encode('utf-8'))
+    return os.path.join(PARSE_CACHE['dir'], kind, key.hexdigest()+'.pickle')
+
+def cached_parse(kind, contents, parser_version, parse):
+    """Return parse(), or the stored result from parsing identical contents"""
+    if not PARSE_CACHE['dir']: return parse()
+    path = parse_cache_path(kind, contents, parser_version)
+    try:
+        with open(path, 'rb') as f: result = pickle.load(f)
+        PARSE_CACHE['hits'] += 1
+        return result
+    except Exception: pass #missing or unreadable -- parse again
+
+    PARSE_CACHE['misses'] += 1
+    result = parse()
+
+    #write then rename so parallel generators never see a partial file
+    tmp_path = '%s.%d.tmp'%(path, os.getpid())
+    try:
+        try: os.makedirs(os.path.dirname(path))
+        except OSError: pass #already exists
+        with open(tmp_path, 'wb') as f: pickle.dump(result, f, pickle.HIGHEST_PROTOCOL)
+        os.rename(tmp_path, path)
+    except Exception as ex:
+        warning('Parse cache write %s failed with %s', path, str(ex))
+        try: os.remove(tmp_path)
+        except OSError: pass
+    return result
+
 ########################################################################
 ## single header inspection
 ########################################################################
@@ -126,10 +168,7 @@ def is_this_class_a_block(className, classInfo):
         if inherit['class'] in KNOWN_BASES: return True
     return False
 
-def inspect_header(header_path):
-    #notice('Inspecting: %s', header_path)
-    contents = io.open(header_path, mode='r', encoding='utf-8').read()
-
+def parse_header(contents):
     #remove API decl tokens so the lexer doesnt have to
     pp_tokens = list()
     for line in contents.splitlines():
@@ -143,9 +182,20 @@ def inspect_header(header_path):
     contents = reWriteEnums(contents)
 
     try: cppHeader = CppHeaderParser.CppHeader(contents, argType='string')
-    except Exception as ex:
-        warning('Inspect %s failed with %s', header_path, str(ex))
+    except Exception as ex: return dict(error=str(ex))
+
+    #only the parts used by the generator, this is what gets cached
+    return dict(CLASSES=cppHeader.CLASSES, functions=cppHeader.functions, enums=cppHeader.enums)
+
+def inspect_header(header_path):
+    #notice('Inspecting: %s', header_path)
+    contents = io.open(header_path, mode='r', encoding='utf-8').read()
+
+    parsed = cached_parse('headers', contents, CppHeaderParser.__version__, lambda: parse_header(contents))
+    if 'error' in parsed:
+        warning('Inspect %s failed with %s', header_path, parsed['error'])
         return
+    cppHeader = AttributeDict(parsed)
 
     if cppHeader.enums:
         ENUM_HEADERS.append(header_path)
@@ -176,12 +226,55 @@ def query_block_classes(cppHeader):
 ## class info into a C++ source
 ########################################################################
 REGISTRATION_TMPL_FILE = os.path.join(os.path.dirname(__file__), 'registration.tmpl.cpp')
+LAZY_INDEX_TMPL_FILE = os.path.join(os.path.dirname(__file__), 'lazy_index.tmpl.cpp')
 from mako.template import Template
 
 def classInfoIntoRegistration(**kwargs):
     tmpl_str = open(REGISTRATION_TMPL_FILE, 'r').read()
+    kwargs.setdefault('lazy', False)
+    kwargs.setdefault('docs_component', None)
+    return Template(tmpl_str).render(**kwargs)
+
+def registrationsIntoLazyIndex(**kwargs):
+    tmpl_str = open(LAZY_INDEX_TMPL_FILE, 'r').read()
     return Template(tmpl_str).render(**kwargs)
 
+def writeIfChanged(path, contents):
+    """Leave unchanged outputs untouched so the build does not recompile them"""
+    try:
+        if open(path, 'r').read() == contents: return False
+    except IOError: pass
+    open(path, 'w').write(contents)
+    return True
+
+def makeDocsStore(blockDescs):
+    """Binary indexed block descriptions, see GrPothosBlock/pothos_block_docs.h"""
+    entries = [(p.encode('utf-8'), d.encode('utf-8')) for p, d in sorted(blockDescs.items())]
+    index = list()
+    strings = list()
+    offset = 12 + 20*len(entries)
+    for p, d in entries:
+        z = zlib.compress(d, 9)
+        index.append(struct.pack('<5I', offset, len(p), offset+len(p), len(z), len(d)))
+        strings.extend([p, z])
+        offset += len(p) + len(z)
+    return b'GRPDOC02' + struct.pack('<I', len(entries)) + b''.join(index) + b''.join(strings)
+
+def writeDocsStore(path, contents):
+    try:
+        if open(path, 'rb').read() == contents: return False
+    except IOError: pass
+    open(path, 'wb').write(contents)
+    return True
+
+def shardOutPath(out_path, shard):
+    base, ext = os.path.splitext(out_path)
+    return '%s_%d%s'%(base, shard, ext)
+
+def shardIndex(name, num_shards):
+    """Stable across runs and python versions, unlike hash()"""
+    return zlib.crc32(name.encode('utf-8')) % num_shards
+
 ########################################################################
 ## gather grc data
 ########################################################################
@@ -192,7 +285,9 @@ import copy
 def gather_grc_data(tree_paths, glob='*.xml'):
     for tree_path in tree_paths:
         for xml_file in glob_recurse(tree_path, glob):
-            yield os.path.splitext(os.path.basename(xml_file))[0], xmltodict.parse(open(xml_file).read())
+            contents = io.open(xml_file, mode='r', encoding='utf-8').read()
+            grc = cached_parse('grc', contents, xmltodict.__version__, lambda: xmltodict.parse(contents))
+            yield os.path.splitext(os.path.basename(xml_file))[0], grc
 
 def getGrcFileMatch(className, classInfo, grc_files):
 
@@ -367,6 +462,23 @@ def find_block_methods(classInfo):
             continue
         yield AttributeDict(method)
 
+def find_direct_calls(classInfo):
+    """
+    Get the block methods that can be called through a typed thunk.
+    Overloads and pointer or non-const reference parameters
+    are left to the registered callables.
+    """
+    methods = list(find_block_methods(classInfo))
+    names = [method['name'] for method in methods]
+    for method in methods:
+        if names.count(method['name']) != 1: continue
+        paramTypes = [p['type'] for p in method['parameters']]
+        if any(['*' in t or ('&' in t and 'const' not in t) for t in paramTypes]): continue
+        rtnType = [t for t in method['rtnType'].split() if t not in ('virtual', 'inline')]
+        returns_void = rtnType == ['void']
+        getter = not paramTypes and not returns_void and method['name'] not in ('start', 'stop')
+        yield AttributeDict(name=method['name'], num_args=len(paramTypes), returns_void=returns_void, getter=getter)
+
 def parse_nested(text, left=r'[(]', right=r'[)]', sep=r','):
     """ Based on http://stackoverflow.com/a/17141899/190597 (falsetru) """
     pat = r'({}|{}|{})'.format(left, right, sep)
@@ -590,6 +702,53 @@ def splitFactoryParam(factory_param):
     #return c++ type, name of the argument, and code to pass into the factory
     return typeStr, argName, argPass
 
+#GRC port types to the C++ element type
+#byte is signed or unsigned depending on the block, leave it to inferDType
+GRC_PORT_TYPES = {
+    'complex': 'std::complex<float>',
+    'float': 'float',
+    'int': 'int',
+    'short': 'short',
+}
+
+def resolveGrcPortType(className, typeStr, grc_params):
+    """
+    Resolve the type of a GRC sink or source to a C++ element type.
+    Types like $type or $type.input refer to the options of a param,
+    the option is picked by the class name suffix (add_ff -> fcn:ff).
+    Return None when the type cannot be resolved.
+    """
+    typeStr = typeStr.strip()
+    m = re.match('^\\$\\(?(\\w+)(\\.(\\w+))?\\)?$', typeStr)
+    if m:
+        key, _, attr = m.groups()
+        if key not in grc_params: return None
+        options = get_as_list(grc_params[key], 'option')
+        suffix = className.split('_')[-1]
+        matches = list()
+        for option in options:
+            opts = dict([o.split(':', 1) for o in get_as_list(option, 'opt') if ':' in o])
+            if len(options) == 1 or option['key'] == suffix or opts.get('fcn') == suffix: matches.append((option, opts))
+        if len(matches) != 1: return None
+        option, opts = matches[0]
+        typeStr = opts.get(attr) if attr else option['key']
+        if typeStr is None: return None
+    return GRC_PORT_TYPES.get(typeStr)
+
+def getGrcPortDTypes(className, blockData, grc_params, direction):
+    """
+    Get the list of port dtypes for all sinks or sources of a GRC block.
+    An empty list means the types should be inferred at runtime.
+    """
+    dtypes = list()
+    for port in get_as_list(blockData, direction):
+        if 'type' not in port: return list()
+        if port['type'] == 'message': continue
+        cppType = resolveGrcPortType(className, port['type'], grc_params)
+        if cppType is None: return list()
+        dtypes.append('Pothos::DType(typeid(%s))'%cppType)
+    return dtypes
+
 def getBlockInfo(className, classInfo, cppHeader, blockData, key_to_categories):
 
     #extract GRC data as lists
@@ -764,12 +923,16 @@ def getBlockInfo(className, classInfo, cppHeader, blockData, key_to_categories):
         used_factory_parameters=used_factory_parameters,
         factory_function_path='::'.join(factory_path),
         exported_factory_args=', '.join(exported_factory_args),
+        num_factory_args=len(exported_factory_args),
         internal_factory_args=', '.join(internal_factory_args),
         block_methods=list(find_block_methods(classInfo)),
+        direct_calls=list(find_direct_calls(classInfo)),
         path=create_block_path(className, classInfo),
         name=className,
         vlen=vlenParam,
-        dtype=dtypeParam
+        dtype=dtypeParam,
+        input_dtypes=getGrcPortDTypes(className, blockData, grc_params, 'sink'),
+        output_dtypes=getGrcPortDTypes(className, blockData, grc_params, 'source'),
     )
 
     blockDesc = dict(
@@ -826,18 +989,22 @@ def createMetaBlockInfo(grc_data, grc_file, info):
     namespace = ''
     for factory, blockDesc in info:
         namespace = factory['namespace']
-        internal_factory_args = ['a%d.convert<%s>()'%(i, stripConstRef(p['type'])) for i, p in enumerate(factory['used_factory_parameters'])]
+        internal_factory_args = ['convertGrPothosArg<%s>(a%d)'%(stripConstRef(p['type']), i) for i, p in enumerate(factory['used_factory_parameters'])]
         sub_factories.append(AttributeDict(
             name=factory['name'], internal_factory_args=', '.join(internal_factory_args)))
 
     #create metafactory
     metaFactoryArgs = ['const std::string &%s'%param_d['key']]
-    metaFactoryArgs += ['const Pothos::Object &a%d'%i for i in range(len(metaBlockDesc['args'])-1)]
+    subFactoryParams = ['const Pothos::Object &a%d'%i for i in range(len(metaBlockDesc['args'])-1)]
+    metaFactoryArgs += subFactoryParams
     metaFactory = AttributeDict(
         type_key=param_d['key'],
+        sub_factory_params=', '.join(subFactoryParams),
+        sub_factory_args=', '.join(['a%d'%i for i in range(len(subFactoryParams))]),
         name=grc_file,
         path=metaBlockDesc['path'],
         exported_factory_args=', '.join(metaFactoryArgs),
+        num_factory_args=len(metaFactoryArgs),
         sub_factories=sub_factories,
         namespace=namespace,
     )
@@ -850,6 +1017,8 @@ def createMetaBlockInfo(grc_data, grc_file, info):
 ########################################################################
 import sys
 import json
+import zlib
+import struct
 import traceback
 from optparse import OptionParser
 
@@ -861,7 +1030,16 @@ def main():
     parser.add_option("--target", help="associated cmake library target name")
     parser.add_option("--prefix", help="installation prefix for gnuradio")
     parser.add_option("--log", help="dump log messages to specified file")
+    parser.add_option("--shards", type="int", default=0, help="split factories into N sources named <out>_<i>.cc")
+    parser.add_option("--stamp", help="touch this file when generation completes")
+    parser.add_option("--cache", help="directory to cache parsed headers and GRC files")
+    parser.add_option("--docs-out", dest="docs_out", help="write compressed block descriptions to a binary store, read by the module at load time")
+    parser.add_option("--lazy-index", dest="lazy_index", help="write a lightweight index source that loads the factories on first use")
+    parser.add_option("--lazy-module", dest="lazy_module", help="factories module path relative to the install root, without suffix")
     (options, args) = parser.parse_args()
+    PARSE_CACHE['dir'] = options.cache
+    lazy = options.lazy_index is not None
+    if lazy and options.lazy_module is None: raise Exception('GrPothosUtil --lazy-index requires --lazy-module')
 
     #check input
     if options.target is None: raise Exception('GrPothosUtil requires --target')
@@ -885,6 +1063,7 @@ def main():
     meta_factories = list()
     registrations = list()
     blockDescs = list()
+    groups = list() #registration and its factories -- always built together
 
     #extract grc metadata
     grc_data = dict(gather_grc_data([grc_path], glob=options.target+"_*.xml"))
@@ -900,6 +1079,7 @@ def main():
             try:
                 file_name = getGrcFileMatch(className, classInfo, grc_data.keys())
                 factory, blockDesc = getBlockInfo(className, classInfo, cppHeader, grc_data[file_name]['block'], key_to_categories)
+                factory.header = headerPath
                 if file_name not in grc_file_to_meta_group: grc_file_to_meta_group[file_name] = list()
                 grc_file_to_meta_group[file_name].append((factory, blockDesc))
                 headers.append(headerPath) #include header on success
@@ -917,6 +1097,7 @@ def main():
                     factories.append(factory)
                 meta_factories.append(metaFactory)
                 registrations.append(metaFactory) #uses keys: name and path
+                groups.append((metaFactory, [factory for factory, blockDesc in info]))
 
             except Exception as ex:
                 error(str(ex))
@@ -926,28 +1107,84 @@ def main():
                 factories.append(factory)
                 registrations.append(factory) #uses keys: name and path
                 blockDescs.append(blockDesc)
+                groups.append((factory, [factory]))
 
     #summary of findings
     notice('%s: Total factories        %d', options.target, len(factories))
     notice('%s: Total meta-factories   %d', options.target, len(meta_factories))
     notice('%s: Total enumerations     %d', options.target, len(DISCOVERED_ENUMS))
     notice('%s: Total registrations    %d', options.target, len(registrations))
+    if options.cache:
+        notice('%s: Parse cache hits       %d', options.target, PARSE_CACHE['hits'])
+        notice('%s: Parse cache misses     %d', options.target, PARSE_CACHE['misses'])
 
     #generate output source
     sort_by_name = lambda l: sorted(l, key=lambda e: e['name'])
-    output = classInfoIntoRegistration(
-        headers=sorted(set(headers+ENUM_HEADERS)),
-        enums=sort_by_name(DISCOVERED_ENUMS),
-        factories=sort_by_name(factories),
-        meta_factories=sort_by_name(meta_factories),
-        registrations=sort_by_name(registrations),
-        blockDescs=dict([(desc['path'], json.dumps(desc)) for desc in blockDescs]),
-    )
+    blockDescs = dict([(desc['path'], json.dumps(desc)) for desc in blockDescs])
+    docs_component = None
+    if options.docs_out:
+        contents = makeDocsStore(blockDescs)
+        writeDocsStore(options.docs_out, contents)
+        docs_component = options.target
+    shards = list()
+    if options.shards > 0 and out_path and out_path != 'stdout':
+        #the main source keeps the docs and enum conversions,
+        #and the factories are split into shards by registration
+        output = classInfoIntoRegistration(
+            headers=sorted(set(ENUM_HEADERS)),
+            enums=sort_by_name(DISCOVERED_ENUMS),
+            factories=list(), meta_factories=list(), registrations=list(),
+            blockDescs=blockDescs,
+            docs_component=docs_component,
+            register_docs=not lazy,
+        )
+        shard_groups = [list() for i in range(options.shards)]
+        for registration, group_factories in groups:
+            shard_groups[shardIndex(registration.name, options.shards)].append((registration, group_factories))
+        for i, shard_group in enumerate(shard_groups):
+            shard_factories = [f for r, fs in shard_group for f in fs]
+            shards.append(classInfoIntoRegistration(
+                headers=sorted(set([f.header for f in shard_factories])),
+                enums=list(),
+                factories=sort_by_name(shard_factories),
+                meta_factories=sort_by_name([r for r, fs in shard_group if 'sub_factories' in r]),
+                registrations=sort_by_name([r for r, fs in shard_group]),
+                blockDescs=dict(),
+                register_docs=False,
+                lazy=lazy,
+            ))
+        notice('%s: Total shards           %d', options.target, len(shards))
+    else:
+        output = classInfoIntoRegistration(
+            headers=sorted(set(headers+ENUM_HEADERS)),
+            enums=sort_by_name(DISCOVERED_ENUMS),
+            factories=sort_by_name(factories),
+            meta_factories=sort_by_name(meta_factories),
+            registrations=sort_by_name(registrations),
+            blockDescs=blockDescs,
+            docs_component=docs_component,
+            register_docs=not lazy,
+            lazy=lazy,
+        )
 
     #send output to file or stdout
     if out_path:
         if out_path == 'stdout': print(output)
-        else: open(out_path, 'w').write(output)
+        else: writeIfChanged(out_path, output)
+    for i, shard in enumerate(shards):
+        writeIfChanged(shardOutPath(out_path, i), shard)
+
+    #the index registers the block paths and docs without gnuradio
+    if lazy:
+        writeIfChanged(options.lazy_index, registrationsIntoLazyIndex(
+            module=options.lazy_module,
+            registrations=sort_by_name(registrations),
+            blockDescs=blockDescs,
+            docs_component=docs_component,
+        ))
+
+    #the stamp tells the build system when generation last ran
+    if options.stamp: open(options.stamp, 'w').close()
 
     #debug dumps of json blocks
     '''
@@ -19,6 +19,8 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "pothos_topology_params.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
@@ -121,7 +123,8 @@ public:
     }
     
     GrConvert(const std::string& inputType, const std::string& outputType, size_t vlen):
-        Pothos::Topology()
+        Pothos::Topology(),
+        d_scale(1.0f)
     {
         const auto& blockInfo = getBlockInfo(inputType, outputType);
         d_hasScale = blockInfo.hasScale;
@@ -133,6 +136,7 @@ public:
 
         if(d_hasScale)
         {
+            d_scale.bind(d_block, "set_scale");
             this->connect(this, "probe_scale", d_block, "probe_scale");
             this->connect(d_block, "scale_triggered", this, "scale_triggered");
         }
@@ -143,18 +147,19 @@ public:
 
     float scale() const
     {
-        if(d_hasScale) return d_block.call<float>("scale");
+        if(d_hasScale) return d_scale.get();
         else return 0.0f;
     }
 
     void set_scale(float scale)
     {
-        if(d_hasScale) d_block.call("set_scale", scale);
+        d_scale.set(scale);
     }
 
 private:
     Pothos::Proxy d_block;
     bool d_hasScale;
+    GrPothosTopologyParam<float> d_scale;
 };
 
 static Pothos::BlockRegistry registerGrConvert(
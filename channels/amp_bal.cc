@@ -19,71 +19,74 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
+
+#include <gnuradio/types.h>
 
 /*
  * Ported from: gr-channels/python/amp_bal.py
  */
 
-static constexpr size_t vlen = 1;
-
-class amp_bal: public Pothos::Topology
+class amp_bal: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(double alpha)
+    static Pothos::Block* make(double alpha)
     {
         return new amp_bal(alpha);
     }
-    
+
     amp_bal(double alpha):
-        Pothos::Topology(),
-        d_alpha(alpha),
-        d_rms_ff0(Pothos::BlockRegistry::make("/gr/blocks/rms", "rms_ff", d_alpha)),
-        d_rms_ff1(Pothos::BlockRegistry::make("/gr/blocks/rms", "rms_ff", d_alpha)),
-        d_multiply_ff(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_ff", vlen)),
-        d_float_to_complex(Pothos::BlockRegistry::make("/gr/blocks/float_to_complex", vlen)),
-        d_divide_ff(Pothos::BlockRegistry::make("/gr/blocks/divide", "divide_ff", vlen)),
-        d_complex_to_float(Pothos::BlockRegistry::make("/gr/blocks/complex_to_float", vlen))
+        Pothos::Block(),
+        d_balance(alpha)
     {
-        this->connect(d_float_to_complex, 0, this, 0);
-        this->connect(this, 0, d_complex_to_float, 0);
-        this->connect(d_complex_to_float, 0, d_rms_ff0, 0);
-        this->connect(d_complex_to_float, 1, d_rms_ff1, 0);
-        this->connect(d_rms_ff0, 0, d_divide_ff, 0);
-        this->connect(d_rms_ff1, 0, d_divide_ff, 1);
-        this->connect(d_complex_to_float, 0, d_float_to_complex, 0);
-        this->connect(d_complex_to_float, 1, d_multiply_ff, 1);
-        this->connect(d_divide_ff, 0, d_multiply_ff, 0);
-        this->connect(d_multiply_ff, 0, d_float_to_complex, 1);
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
 
         this->registerCall(this, POTHOS_FCN_TUPLE(amp_bal, alpha));
         this->registerCall(this, POTHOS_FCN_TUPLE(amp_bal, set_alpha));
+        this->registerCall(this, POTHOS_FCN_TUPLE(amp_bal, ratio));
+        this->registerProbe("alpha", "alpha_triggered", "probe_alpha");
+        this->registerProbe("ratio", "ratio_triggered", "probe_ratio");
     }
 
     double alpha() const
     {
-        return d_alpha;
+        return d_balance.alpha;
     }
 
     void set_alpha(double alpha)
     {
-        d_alpha = alpha;
-        d_rms_ff0.call("set_alpha", alpha);
-        d_rms_ff1.call("set_alpha", alpha);
+        d_balance.alpha = alpha;
+    }
+
+    //! The current RMS(I)/RMS(Q) the quadrature component is scaled by
+    float ratio() const
+    {
+        return d_balance.ratio();
+    }
+
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        d_balance.apply(inPort->buffer().as<const gr_complex *>(), outPort->buffer().as<gr_complex *>(), num);
+
+        inPort->consume(num);
+        outPort->produce(num);
     }
 
 private:
-    double d_alpha;
-
-    Pothos::Proxy d_rms_ff0;
-    Pothos::Proxy d_rms_ff1;
-    Pothos::Proxy d_multiply_ff;
-    Pothos::Proxy d_float_to_complex;
-    Pothos::Proxy d_divide_ff;
-    Pothos::Proxy d_complex_to_float;
+    AmplitudeBalance d_balance;
 };
 
 /***********************************************************************
@@ -91,6 +94,10 @@ private:
  *
  * Restores IQ amplitude balance.
  *
+ * The running RMS of each component is tracked sample by sample and the
+ * quadrature component is scaled by their ratio.
+ * The current ratio can be read with the ratio probe.
+ *
  * |category /GNURadio/Impairments
  * |keywords rf iq rms alpha
  *
@@ -106,3 +113,22 @@ private:
 static Pothos::BlockRegistry registerAmpBal(
     "/gr/channels/amp_bal",
     Pothos::Callable(&amp_bal::make));
+
+/***********************************************************************
+ * Known answers from the gr-channels amp_bal recurrence in double precision:
+ * Q is scaled by the running ratio of the I and Q RMS
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_amp_bal_known_answers)
+{
+    auto balance = Pothos::BlockRegistry::make("/gr/channels/amp_bal", 0.5);
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(1.0000000f, 1.0000000f),
+        gr_complex(0.8000000f, -0.8000000f),
+        gr_complex(0.0000000f, 0.0000000f),
+        gr_complex(-0.6000000f, 0.6000000f),
+        gr_complex(0.5000000f, 0.7011491f)},
+        runChannelBlock<gr_complex>(balance, std::vector<gr_complex>{
+            gr_complex(1.0f, 0.5f), gr_complex(0.8f, -0.4f), gr_complex(0.0f, 0.0f),
+            gr_complex(-0.6f, 0.3f), gr_complex(0.5f, 0.7f)}), 1e-6f);
+    POTHOS_TEST_CLOSE(balance.call<float>("ratio"), 1.0016416f, 1e-6f);
+}
@@ -19,87 +19,223 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
 
+#include <gnuradio/fft/fft.h>
 #include <gnuradio/gr_complex.h>
+#include <volk/volk.h>
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include <vector>
 
 /*
  * Ported from: gr-channels/python/conj_fs_iqcorr.py
+ *
+ * out[n] = in[n-delay] + sum(taps[k]*conj(in[n-k]))
+ *
+ * The hierarchical block runs conjugate_cc into fir_filter_ccc and adds
+ * a delayed copy of the input. Here both paths read one history buffer
+ * of the raw input and are summed as the output is written. Short
+ * filters use VOLK dot products; long filters use an overlap-save FFT
+ * convolution. Either way, the only filter state is the input history,
+ * so new taps apply cleanly from the first sample of the next work().
  */
 
-static constexpr int decimation = 1;
-static constexpr size_t vlen = 1;
+//tap count where the overlap-save convolution overtakes the dot products
+static constexpr size_t fftMinTaps = 64;
 
-class conj_fs_iqcorr: public Pothos::Topology
+class conj_fs_iqcorr: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(int delay, const std::vector<gr_complex>& taps)
+    static Pothos::Block* make(int delay, const std::vector<gr_complex>& taps)
     {
         return new conj_fs_iqcorr(delay, taps);
     }
-    
+
     conj_fs_iqcorr(int delay, const std::vector<gr_complex>& taps):
-        Pothos::Topology(),
-        d_fir_filter_ccc(Pothos::BlockRegistry::make("/gr/filter/fir_filter", "fir_filter_ccc", decimation, taps)),
-        d_delay(Pothos::BlockRegistry::make("/gr/blocks/delay", "complex_float32", delay)),
-        d_conjugate_cc(Pothos::BlockRegistry::make("/gr/blocks/conjugate_cc")),
-        d_add_cc(Pothos::BlockRegistry::make("/gr/blocks/add", "add_cc", vlen))
+        Pothos::Block(),
+        d_delay(0),
+        d_fft_size(0)
     {
-        this->connect(d_add_cc, 0, this, 0);
-        this->connect(this, 0, d_conjugate_cc, 0);
-        this->connect(d_fir_filter_ccc, 0, d_add_cc, 1);
-        this->connect(d_conjugate_cc, 0, d_fir_filter_ccc, 0);
-        this->connect(this, 0, d_delay, 0);
-        this->connect(d_delay, 0, d_add_cc, 0);
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
 
         this->registerCall(this, POTHOS_FCN_TUPLE(conj_fs_iqcorr, delay));
-        this->connect(this, "set_delay", d_delay, "set_dly");
-        this->connect(this, "probe_delay", d_delay, "probe_dly");
-        this->connect(d_delay, "dly_triggered", this, "delay_triggered");
-
+        this->registerCall(this, POTHOS_FCN_TUPLE(conj_fs_iqcorr, set_delay));
         this->registerCall(this, POTHOS_FCN_TUPLE(conj_fs_iqcorr, taps));
-        this->connect(this, "set_taps", d_fir_filter_ccc, "set_taps");
-        this->connect(this, "probe_taps", d_fir_filter_ccc, "probe_taps");
-        this->connect(d_fir_filter_ccc, "taps_triggered", this, "taps_triggered");
+        this->registerCall(this, POTHOS_FCN_TUPLE(conj_fs_iqcorr, set_taps));
+        this->registerProbe("delay", "delay_triggered", "probe_delay");
+        this->registerProbe("taps", "taps_triggered", "probe_taps");
+
+        this->set_delay(delay);
+        this->set_taps(taps);
     }
 
     int delay() const
     {
-        return d_delay.call("dly");
+        return d_delay;
+    }
+
+    void set_delay(int delay)
+    {
+        if (delay < 0) throw Pothos::InvalidArgumentException("conj_fs_iqcorr: negative delay", std::to_string(delay));
+        d_delay = delay;
+        this->resizeHistory();
     }
 
     std::vector<gr_complex> taps() const
     {
-        return d_fir_filter_ccc.call("taps");
+        return d_taps;
     }
 
-    Pothos::Object opaqueCallMethod(const std::string &name, const Pothos::Object *inputArgs, const size_t numArgs) const
+    void set_taps(const std::vector<gr_complex>& taps)
     {
-        // Try the topology first, then the two other blocks with relevant calls.
-        try
+        d_taps = taps;
+        d_filter_taps = taps.empty()? std::vector<gr_complex>(1) : taps;
+        const size_t numTaps = d_filter_taps.size();
+
+        if (numTaps < fftMinTaps)
         {
-            return Pothos::Topology::opaqueCallMethod(name, inputArgs, numArgs);
+            d_fft_size = 0;
+            d_fwd.reset();
+            d_inv.reset();
+            d_reversed_taps.assign(d_filter_taps.rbegin(), d_filter_taps.rend());
         }
-        catch (const Pothos::BlockCallNotFound&){}
-        try
+        else
+        {
+            //at least 4x the taps so most of each transform is new output
+            size_t fftSize = 1;
+            while (fftSize < 4*numTaps) fftSize *= 2;
+            if (fftSize != d_fft_size)
+            {
+                d_fft_size = fftSize;
+                d_fwd.reset(new gr::fft::fft_complex(fftSize, true));
+                d_inv.reset(new gr::fft::fft_complex(fftSize, false));
+            }
+
+            //the inverse transform is unnormalized, so fold 1/N into the taps
+            gr_complex *fftIn = d_fwd->get_inbuf();
+            std::fill(fftIn, fftIn+fftSize, gr_complex(0.0f));
+            for (size_t k = 0; k < numTaps; k++) fftIn[k] = d_filter_taps[k]/float(fftSize);
+            d_fwd->execute();
+            d_freq_taps.assign(d_fwd->get_outbuf(), d_fwd->get_outbuf()+fftSize);
+        }
+
+        this->resizeHistory();
+    }
+
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        const auto in = inPort->buffer().as<const gr_complex *>();
+        const auto out = outPort->buffer().as<gr_complex *>();
+
+        //only the outputs that reach back past the input read the history,
+        //from a buffer of the history followed by the start of the input
+        const size_t history = d_history.size();
+        const size_t bridge = std::min(num, this->requiredHistory());
+        d_buffer.resize(history+bridge);
+        std::copy(d_history.begin(), d_history.end(), d_buffer.begin());
+        std::copy(in, in+bridge, d_buffer.begin()+history);
+        this->filter(d_buffer.data()+history, out, bridge);
+        this->filter(in+bridge, out+bridge, num-bridge);
+
+        //keep the newest input as the history
+        if (num >= history) std::copy(in+num-history, in+num, d_history.begin());
+        else
         {
-            return d_delay.call<Pothos::Block*>("getPointer")->opaqueCallMethod(name, inputArgs, numArgs);
+            std::copy(d_history.begin()+num, d_history.end(), d_history.begin());
+            std::copy(in, in+num, d_history.end()-num);
         }
-        catch (const Pothos::BlockCallNotFound&){}
 
-        return d_fir_filter_ccc.call<Pothos::Block*>("getPointer")->opaqueCallMethod(name, inputArgs, numArgs);
+        inPort->consume(num);
+        outPort->produce(num);
     }
 
 private:
-    Pothos::Proxy d_fir_filter_ccc;
-    Pothos::Proxy d_delay;
-    Pothos::Proxy d_conjugate_cc;
-    Pothos::Proxy d_add_cc;
+    //x[i-k] must be valid for k <= requiredHistory()
+    void filter(const gr_complex *x, gr_complex *out, const size_t num)
+    {
+        if (num == 0) return;
+        const gr_complex *delayed = x-d_delay;
+
+        const size_t numTaps = d_filter_taps.size();
+        if (d_fft_size == 0)
+        {
+            d_conj.resize(numTaps-1+num);
+            volk_32fc_conjugate_32fc(d_conj.data(), x-(numTaps-1), numTaps-1+num);
+            for (size_t i = 0; i < num; i++)
+            {
+                gr_complex acc;
+                volk_32fc_x2_dot_prod_32fc(&acc, d_conj.data()+i, d_reversed_taps.data(), numTaps);
+                out[i] = delayed[i] + acc;
+            }
+        }
+        else
+        {
+            //a short last block is zero padded, which only affects the
+            //outputs past the end of the block that are not written
+            const size_t blockSize = d_fft_size-numTaps+1;
+            gr_complex *fftIn = d_fwd->get_inbuf();
+            for (size_t i = 0; i < num; i += blockSize)
+            {
+                const size_t n = std::min(blockSize, num-i);
+                volk_32fc_conjugate_32fc(fftIn, x+i-(numTaps-1), numTaps-1+n);
+                std::fill(fftIn+numTaps-1+n, fftIn+d_fft_size, gr_complex(0.0f));
+                d_fwd->execute();
+                volk_32fc_x2_multiply_32fc(d_inv->get_inbuf(), d_fwd->get_outbuf(), d_freq_taps.data(), d_fft_size);
+                d_inv->execute();
+                const gr_complex *y = d_inv->get_outbuf()+numTaps-1;
+                for (size_t j = 0; j < n; j++) out[i+j] = delayed[i+j] + y[j];
+            }
+        }
+    }
+
+    //the input needed before each output for the filter and the delay
+    size_t requiredHistory(void) const
+    {
+        const size_t size = std::max(d_filter_taps.size(), size_t(1))-1;
+        return std::max(size, size_t(d_delay));
+    }
+
+    //The history only grows: it holds the most input that any delay and
+    //taps so far have needed, so returning to a longer filter or delay
+    //reads real input. Growing past that maximum can only add zeros for
+    //input that was never kept, a transient of at most the new history.
+    void resizeHistory(void)
+    {
+        const size_t history = this->requiredHistory();
+        if (history > d_history.size()) d_history.insert(d_history.begin(), history-d_history.size(), gr_complex(0.0f));
+    }
+
+    int d_delay;
+    std::vector<gr_complex> d_taps;
+    std::vector<gr_complex> d_filter_taps;
+
+    //time domain
+    std::vector<gr_complex> d_reversed_taps;
+    std::vector<gr_complex> d_conj;
+
+    //overlap-save, d_fft_size is 0 when filtering in the time domain
+    size_t d_fft_size;
+    std::unique_ptr<gr::fft::fft_complex> d_fwd;
+    std::unique_ptr<gr::fft::fft_complex> d_inv;
+    std::vector<gr_complex> d_freq_taps;
+
+    std::vector<gr_complex> d_history;
+    std::vector<gr_complex> d_buffer;
 };
 
 /***********************************************************************
@@ -121,7 +257,83 @@ private:
  * |preview disable
  *
  * |factory /gr/channels/conj_fs_iqcorr(delay,taps)
+ * |setter set_delay(delay)
+ * |setter set_taps(taps)
  **********************************************************************/
 static Pothos::BlockRegistry registerConjFSIQCorr(
     "/gr/channels/conj_fs_iqcorr",
     Pothos::Callable(&conj_fs_iqcorr::make));
+
+/***********************************************************************
+ * Known answers in the time domain, and the overlap-save path against
+ * out[n] = in[n-delay] + sum(taps[k]*conj(in[n-k])) with an impulse
+ * filter long enough to select it
+ **********************************************************************/
+static std::vector<gr_complex> conjFsIqcorrInput(const size_t offset, const size_t num)
+{
+    std::vector<gr_complex> x;
+    for (size_t n = offset; n < offset+num; n++)
+    {
+        x.emplace_back(0.5f*std::cos(0.1f*n), 0.3f*std::sin(0.37f*n));
+    }
+    return x;
+}
+
+//taps[0] = 0.5 and taps[fftMinTaps+6] = -0.25j
+static std::vector<gr_complex> conjFsIqcorrImpulse(void)
+{
+    std::vector<gr_complex> taps(fftMinTaps+7);
+    taps.front() = gr_complex(0.5f, 0.0f);
+    taps.back() = gr_complex(0.0f, -0.25f);
+    return taps;
+}
+
+static gr_complex conjFsIqcorrImpulseOut(const std::vector<gr_complex> &x, const size_t n, const size_t delay)
+{
+    const size_t lag = fftMinTaps+6;
+    gr_complex y = gr_complex(0.5f, 0.0f)*std::conj(x[n]);
+    if (n >= delay) y += x[n-delay];
+    if (n >= lag) y += gr_complex(0.0f, -0.25f)*std::conj(x[n-lag]);
+    return y;
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_conj_fs_iqcorr_known_answers)
+{
+    auto iqcorr = Pothos::BlockRegistry::make("/gr/channels/conj_fs_iqcorr", 1,
+        std::vector<gr_complex>{gr_complex(0.1f, 0.05f), gr_complex(0.0f, -0.02f)});
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.1000000f, 0.0500000f),
+        gr_complex(1.0500000f, -0.1200000f),
+        gr_complex(0.0050000f, 1.0750000f),
+        gr_complex(0.4225000f, -0.5850000f)},
+        runChannelBlock<gr_complex>(iqcorr, std::vector<gr_complex>{
+            gr_complex(1.0f, 0.0f), gr_complex(0.0f, 1.0f),
+            gr_complex(0.5f, -0.5f), gr_complex(-1.0f, 0.25f)}), 1e-6f);
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_conj_fs_iqcorr_overlap_save)
+{
+    const size_t delay = 3;
+    const auto x = conjFsIqcorrInput(0, 1000);
+    auto iqcorr = Pothos::BlockRegistry::make("/gr/channels/conj_fs_iqcorr", int(delay), conjFsIqcorrImpulse());
+
+    std::vector<gr_complex> expected;
+    for (size_t n = 0; n < x.size(); n++) expected.push_back(conjFsIqcorrImpulseOut(x, n, delay));
+    testChannelClose(expected, runChannelBlock<gr_complex>(iqcorr, x), 1e-5f);
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_conj_fs_iqcorr_history)
+{
+    //the long filter was used before, so its history is kept while short
+    auto iqcorr = Pothos::BlockRegistry::make("/gr/channels/conj_fs_iqcorr", 0, conjFsIqcorrImpulse());
+    iqcorr.call("set_taps", std::vector<gr_complex>{gr_complex(0.5f, 0.0f)});
+    const auto first = conjFsIqcorrInput(0, 200);
+    runChannelBlock<gr_complex>(iqcorr, first);
+
+    //switching back reads the earlier input rather than zeros
+    iqcorr.call("set_taps", conjFsIqcorrImpulse());
+    const auto x = conjFsIqcorrInput(0, 500);
+    std::vector<gr_complex> expected;
+    for (size_t n = first.size(); n < x.size(); n++) expected.push_back(conjFsIqcorrImpulseOut(x, n, 0));
+    testChannelClose(expected, runChannelBlock<gr_complex>(iqcorr, conjFsIqcorrInput(first.size(), 300)), 1e-5f);
+}
@@ -19,76 +19,77 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
 
 #include <gnuradio/types.h>
 
 /*
  * Ported from: gr-channels/python/distortion_2_gen.py
+ *
+ * Computes x + beta*x*2*Re(x) with the polynomial kernel
+ * of the nonlinearity block instead of a topology of arithmetic blocks.
  */
 
-static constexpr size_t vlen = 1;
-
-class distortion_2_gen: public Pothos::Topology
+class distortion_2_gen: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(const gr_complex& beta)
+    static Pothos::Block* make(const gr_complex& beta)
     {
         return new distortion_2_gen(beta);
     }
-    
+
     distortion_2_gen(const gr_complex& beta):
-        Pothos::Topology(),
-        d_multiply_cc0(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_cc", vlen)),
-        d_multiply_cc1(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_cc", vlen)),
-        d_multiply_const_cc0(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_cc", beta, vlen)),
-        d_conjugate_cc0(Pothos::BlockRegistry::make("/gr/blocks/conjugate_cc")),
-        d_add_cc0(Pothos::BlockRegistry::make("/gr/blocks/add", "add_cc", vlen)),
-        d_add_cc1(Pothos::BlockRegistry::make("/gr/blocks/add", "add_cc", vlen))
+        Pothos::Block(),
+        d_beta(beta),
+        d_polynomial(coefficients(beta), Polynomial::IN_PHASE)
     {
-        // Assemble flowgraph
-        this->connect(d_multiply_const_cc0, 0, d_add_cc0, 1);
-        this->connect(this, 0, d_multiply_cc0, 0);
-        this->connect(this, 0, d_add_cc0, 0);
-        this->connect(d_add_cc0, 0, this, 0);
-        this->connect(this, 0, d_conjugate_cc0, 0);
-        this->connect(d_conjugate_cc0, 0, d_multiply_cc1, 1);
-        this->connect(this, 0, d_multiply_cc0, 1);
-        this->connect(this, 0, d_multiply_cc1, 0);
-        this->connect(d_multiply_cc1, 0, d_add_cc1, 1);
-        this->connect(d_multiply_cc0, 0, d_add_cc1, 0);
-        this->connect(d_add_cc1, 0, d_multiply_const_cc0, 0);
-
-        // Add calls or connect to internal calls
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
+
         this->registerCall(this, POTHOS_FCN_TUPLE(distortion_2_gen, beta));
         this->registerCall(this, POTHOS_FCN_TUPLE(distortion_2_gen, set_beta));
-        this->connect(this, "set_beta", d_multiply_const_cc0, "set_k");
-        this->connect(this, "probe_beta", d_multiply_const_cc0, "probe_k");
-        this->connect(d_multiply_const_cc0, "k_triggered", this, "beta_triggered");
+        this->registerProbe("beta", "beta_triggered", "probe_beta");
     }
 
     gr_complex beta() const
     {
-        return d_multiply_const_cc0.call("k");
+        return d_beta;
     }
 
-    // Put this here so we can connect to the internal block.
-    void set_beta(const gr_complex& /*beta*/) {}
+    void set_beta(const gr_complex& beta)
+    {
+        d_beta = beta;
+        d_polynomial.setCoefficients(coefficients(beta), Polynomial::IN_PHASE);
+    }
 
-private:
-    Pothos::Proxy d_multiply_cc0;
-    Pothos::Proxy d_multiply_cc1;
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
 
-    // This was multiply_const_vcc in the original flowgraph for no reason. We're
-    // changing it here to make connecting the topology to the block easier.
-    Pothos::Proxy d_multiply_const_cc0;
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        d_polynomial.apply(inPort->buffer().as<const gr_complex *>(), outPort->buffer().as<gr_complex *>(), num);
 
-    Pothos::Proxy d_conjugate_cc0;
-    Pothos::Proxy d_add_cc0;
-    Pothos::Proxy d_add_cc1;
+        inPort->consume(num);
+        outPort->produce(num);
+    }
+
+private:
+    static std::vector<gr_complex> coefficients(const gr_complex& beta)
+    {
+        return {1.0f, beta};
+    }
+
+    gr_complex d_beta;
+    Polynomial d_polynomial;
 };
 
 /***********************************************************************
@@ -110,3 +111,19 @@ private:
 static Pothos::BlockRegistry registerDistortion2Gen(
     "/gr/channels/distortion_2_gen",
     Pothos::Callable(&distortion_2_gen::make));
+
+/***********************************************************************
+ * Known answers from x + beta*x*2*Re(x) in double precision
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_distortion_2_gen_known_answers)
+{
+    auto distortion = Pothos::BlockRegistry::make("/gr/channels/distortion_2_gen", gr_complex(-0.2f, 0.1f));
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.3750000f, 0.2500000f),
+        gr_complex(-0.3300000f, 0.1300000f),
+        gr_complex(0.0000000f, -0.6000000f),
+        gr_complex(0.5440000f, 0.1280000f)},
+        runChannelBlock<gr_complex>(distortion, std::vector<gr_complex>{
+            gr_complex(0.5f, 0.25f), gr_complex(-0.3f, 0.1f),
+            gr_complex(0.0f, -0.6f), gr_complex(0.8f, 0.0f)}), 1e-6f);
+}
@@ -19,74 +19,77 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
 
 #include <gnuradio/types.h>
 
 /*
  * Ported from: gr-channels/python/distortion_3_gen.py
+ *
+ * Computes x + beta*x*|x|^2 with the polynomial kernel
+ * of the nonlinearity block instead of a topology of arithmetic blocks.
  */
 
-static constexpr size_t vlen = 1;
-
-class distortion_3_gen: public Pothos::Topology
+class distortion_3_gen: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(const gr_complex& beta)
+    static Pothos::Block* make(const gr_complex& beta)
     {
         return new distortion_3_gen(beta);
     }
-    
+
     distortion_3_gen(const gr_complex& beta):
-        Pothos::Topology(),
-        d_null_source0(Pothos::BlockRegistry::make("/gr/blocks/null_source", Pothos::DType(typeid(float)))),
-        d_multiply_cc0(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_cc", vlen)),
-        d_multiply_const_cc0(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_cc", beta, vlen)),
-        d_float_to_complex0(Pothos::BlockRegistry::make("/gr/blocks/float_to_complex", vlen)),
-        d_complex_to_mag_squared0(Pothos::BlockRegistry::make("/gr/blocks/complex_to_mag_squared", vlen)),
-        d_add_cc0(Pothos::BlockRegistry::make("/gr/blocks/add", "add_cc", vlen))
+        Pothos::Block(),
+        d_beta(beta),
+        d_polynomial(coefficients(beta), Polynomial::ENVELOPE)
     {
-        // Assemble flowgraph
-        this->connect(d_float_to_complex0, 0, d_multiply_cc0, 1);
-        this->connect(d_null_source0, 0, d_float_to_complex0, 1);
-        this->connect(d_complex_to_mag_squared0, 0, d_float_to_complex0, 0);
-        this->connect(d_multiply_const_cc0, 0, d_add_cc0, 1);
-        this->connect(d_multiply_cc0, 0, d_multiply_const_cc0, 0);
-        this->connect(this, 0, d_complex_to_mag_squared0, 0);
-        this->connect(this, 0, d_multiply_cc0, 0);
-        this->connect(this, 0, d_add_cc0, 0);
-        this->connect(d_add_cc0, 0, this, 0);
-
-        // Add calls or connect to internal calls
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
+
         this->registerCall(this, POTHOS_FCN_TUPLE(distortion_3_gen, beta));
         this->registerCall(this, POTHOS_FCN_TUPLE(distortion_3_gen, set_beta));
-        this->connect(this, "set_beta", d_multiply_const_cc0, "set_k");
-        this->connect(this, "probe_beta", d_multiply_const_cc0, "probe_k");
-        this->connect(d_multiply_const_cc0, "k_triggered", this, "beta_triggered");
+        this->registerProbe("beta", "beta_triggered", "probe_beta");
     }
 
     gr_complex beta() const
     {
-        return d_multiply_const_cc0.call("k");
+        return d_beta;
     }
 
-    // Put this here so we can connect to the internal block.
-    void set_beta(const gr_complex& /*beta*/) {}
+    void set_beta(const gr_complex& beta)
+    {
+        d_beta = beta;
+        d_polynomial.setCoefficients(coefficients(beta), Polynomial::ENVELOPE);
+    }
 
-private:
-    Pothos::Proxy d_null_source0;
-    Pothos::Proxy d_multiply_cc0;
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
 
-    // This was multiply_const_vcc in the original flowgraph for no reason. We're
-    // changing it here to make connecting the topology to the block easier.
-    Pothos::Proxy d_multiply_const_cc0;
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        d_polynomial.apply(inPort->buffer().as<const gr_complex *>(), outPort->buffer().as<gr_complex *>(), num);
 
-    Pothos::Proxy d_float_to_complex0;
-    Pothos::Proxy d_complex_to_mag_squared0;
-    Pothos::Proxy d_add_cc0;
+        inPort->consume(num);
+        outPort->produce(num);
+    }
+
+private:
+    static std::vector<gr_complex> coefficients(const gr_complex& beta)
+    {
+        return {1.0f, 0.0f, beta};
+    }
+
+    gr_complex d_beta;
+    Polynomial d_polynomial;
 };
 
 /***********************************************************************
@@ -108,3 +111,19 @@ private:
 static Pothos::BlockRegistry registerDistortion3Gen(
     "/gr/channels/distortion_3_gen",
     Pothos::Callable(&distortion_3_gen::make));
+
+/***********************************************************************
+ * Known answers from x + beta*x*|x|^2 in double precision
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_distortion_3_gen_known_answers)
+{
+    auto distortion = Pothos::BlockRegistry::make("/gr/channels/distortion_3_gen", gr_complex(-0.2f, 0.1f));
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.4609375f, 0.2500000f),
+        gr_complex(-0.2950000f, 0.0950000f),
+        gr_complex(0.0216000f, -0.5568000f),
+        gr_complex(0.6976000f, 0.0512000f)},
+        runChannelBlock<gr_complex>(distortion, std::vector<gr_complex>{
+            gr_complex(0.5f, 0.25f), gr_complex(-0.3f, 0.1f),
+            gr_complex(0.0f, -0.6f), gr_complex(0.8f, 0.0f)}), 1e-6f);
+}
@@ -0,0 +1,601 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <gnuradio/types.h>
+#include <volk/volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Sample kernels shared by the native channel blocks.
+ *
+ * Blocks process their input in chunks of IMPAIRMENT_CHUNK_SIZE so that
+ * the intermediate buffers (noise, rotations) stay in cache, and apply
+ * all memoryless stages to a sample in a single loop over the chunk.
+ */
+
+static constexpr size_t IMPAIRMENT_CHUNK_SIZE = 512;
+
+//! Convert a magnitude in dB to a linear amplitude
+inline float dbToAmplitude(const float db)
+{
+    return std::pow(10.0f, db/20.0f);
+}
+
+/***********************************************************************
+ * sin and cos of x with a polynomial on [-pi/4, pi/4] after reducing
+ * x by multiples of pi/2. Branch free so loops over it vectorize,
+ * accurate to a few ulp for the small phases used by the blocks.
+ **********************************************************************/
+inline void fastSinCos(const float x, float &s, float &c)
+{
+    const float q = std::floor(x*float(2/M_PI) + 0.5f);
+    const int n = int(q);
+
+    //pi/2 split in two parts for an exact reduction (Cody-Waite)
+    const float r = (x - q*1.5707963705062866f) + q*4.371139000186241e-08f;
+    const float r2 = r*r;
+    const float sr = r + r*r2*(-1.6666654611e-1f + r2*(8.3321608736e-3f + r2*(-1.9515295891e-4f)));
+    const float cr = 1.0f - 0.5f*r2 + r2*r2*(4.166664568298827e-2f + r2*(-1.388731625493765e-3f + r2*2.443315711809948e-5f));
+
+    //select and negate by the quadrant
+    const bool swap = (n & 1) != 0;
+    const float s0 = swap? cr : sr;
+    const float c0 = swap? sr : cr;
+    s = ((n & 2) != 0)? -s0 : s0;
+    c = (((n+1) & 2) != 0)? -c0 : c0;
+}
+
+/***********************************************************************
+ * Local oscillator: exp(j*2*pi*freq*n), freq in cycles per sample.
+ * mixDown() multiplies by the conjugate starting at the current phase,
+ * mixUp() multiplies by the oscillator and advances the phase, so for
+ * a chunk mixed in both directions call mixDown() first.
+ **********************************************************************/
+struct Oscillator
+{
+    Oscillator(void):
+        phase(1.0f, 0.0f),
+        phaseInc(1.0f, 0.0f)
+    {
+        return;
+    }
+
+    void setFrequency(const float freq)
+    {
+        phaseInc = std::polar(1.0f, float(2*M_PI*freq));
+    }
+
+    bool isIdentity(void) const
+    {
+        return phaseInc == gr_complex(1.0f, 0.0f) and phase == gr_complex(1.0f, 0.0f);
+    }
+
+    void mixDown(const gr_complex *in, gr_complex *out, const size_t num) const
+    {
+        gr_complex conjPhase = std::conj(phase);
+        volk_32fc_s32fc_x2_rotator_32fc(out, in, std::conj(phaseInc), &conjPhase, num);
+    }
+
+    void mixUp(const gr_complex *in, gr_complex *out, const size_t num)
+    {
+        volk_32fc_s32fc_x2_rotator_32fc(out, in, phaseInc, &phase, num);
+    }
+
+    gr_complex phase;
+    gr_complex phaseInc;
+};
+
+/***********************************************************************
+ * Counter-based Gaussian noise
+ *
+ * Philox4x32-10 maps (counter, key) to four random words with no state
+ * besides the counter, so any sample of a stream can be generated
+ * directly: the key is the seed, the upper counter words are the
+ * stream ID and the lower words are the sample index / 4. Streams with
+ * different IDs are independent, and a run split across threads or
+ * processes by seeking reproduces the single threaded noise exactly.
+ **********************************************************************/
+inline void philox4x32(uint32_t ctr[4], uint32_t key0, uint32_t key1)
+{
+    for (size_t round = 0; round < 10; round++)
+    {
+        const uint64_t p0 = uint64_t(0xD2511F53)*ctr[0];
+        const uint64_t p1 = uint64_t(0xCD9E8D57)*ctr[2];
+        const uint32_t hi0 = uint32_t(p0 >> 32), lo0 = uint32_t(p0);
+        const uint32_t hi1 = uint32_t(p1 >> 32), lo1 = uint32_t(p1);
+        ctr[0] = hi1^ctr[1]^key0;
+        ctr[1] = lo1;
+        ctr[2] = hi0^ctr[3]^key1;
+        ctr[3] = lo0;
+        key0 += 0x9E3779B9;
+        key1 += 0xBB67AE85;
+    }
+}
+
+struct GaussianNoise
+{
+    GaussianNoise(const uint64_t seed, const uint64_t stream):
+        seed(seed),
+        stream(stream),
+        position(0),
+        bits(IMPAIRMENT_CHUNK_SIZE),
+        values(IMPAIRMENT_CHUNK_SIZE)
+    {
+        return;
+    }
+
+    //! Move to any sample offset of the stream
+    void seek(const uint64_t offset)
+    {
+        position = offset;
+    }
+
+    //! Fill with unit variance Gaussian samples and advance the position
+    void fill(float *out, size_t num)
+    {
+        while (num != 0)
+        {
+            //generate whole blocks of four and skip into the first one
+            const size_t skip = size_t(position % 4);
+            const size_t numBlocks = std::min((skip+num+3)/4, IMPAIRMENT_CHUNK_SIZE/4);
+            const uint64_t block = position/4;
+
+            //independent counters, so this loop vectorizes across blocks
+            for (size_t i = 0; i < numBlocks; i++)
+            {
+                uint32_t ctr[4] = {
+                    uint32_t(block+i), uint32_t((block+i) >> 32),
+                    uint32_t(stream), uint32_t(stream >> 32)};
+                philox4x32(ctr, uint32_t(seed), uint32_t(seed >> 32));
+                for (size_t j = 0; j < 4; j++) bits[4*i+j] = ctr[j];
+            }
+
+            //Box-Muller on pairs of uniforms in (0, 1)
+            for (size_t i = 0; i < 2*numBlocks; i++)
+            {
+                const float u0 = (float(bits[2*i+0] >> 8) + 0.5f)*(1.0f/16777216.0f);
+                const float u1 = (float(bits[2*i+1] >> 8) + 0.5f)*(1.0f/16777216.0f);
+                const float r = std::sqrt(-2.0f*std::log(u0));
+                float s, c;
+                fastSinCos(float(2*M_PI)*u1, s, c);
+                values[2*i+0] = r*c;
+                values[2*i+1] = r*s;
+            }
+
+            const size_t n = std::min(num, 4*numBlocks-skip);
+            std::copy(values.begin()+skip, values.begin()+skip+n, out);
+            out += n;
+            num -= n;
+            position += n;
+        }
+    }
+
+    uint64_t seed;
+    uint64_t stream;
+    uint64_t position;
+    std::vector<uint32_t> bits;
+    std::vector<float> values;
+};
+
+/***********************************************************************
+ * Phase noise: Gaussian noise through a single pole IIR filter,
+ * applied as a rotation by complex(sin(phi), cos(phi)) which matches
+ * the float_to_complex(sin, cos) wiring of gr-channels phase_noise_gen.
+ **********************************************************************/
+static constexpr uint64_t PHASE_NOISE_MAX_WARMUP = 1 << 20;
+
+struct PhaseNoise
+{
+    PhaseNoise(const float amplitude, const float alpha, const uint64_t seed, const uint64_t stream = 0):
+        amplitude(amplitude),
+        alpha(alpha),
+        prev(0.0f),
+        noise(seed, stream),
+        phases(IMPAIRMENT_CHUNK_SIZE)
+    {
+        return;
+    }
+
+    //The filter state is rebuilt from the noise before the offset, over
+    //enough samples for the old state to decay below float precision, so
+    //the phases after a seek match a sequential run to within about 1e-7
+    //of the state. Filters without memory (alpha 0 or 1) match exactly.
+    //The replay is capped at PHASE_NOISE_MAX_WARMUP samples, which only
+    //limits the match for alpha below about 1.5e-5.
+    void seek(const uint64_t offset)
+    {
+        const float pole = std::abs(1.0f-alpha);
+        uint64_t warmup = 0;
+        if (pole > 0.0f and pole < 1.0f)
+        {
+            const double decay = std::ceil(std::log(1e-7)/std::log(double(pole)));
+            warmup = uint64_t(std::min(decay, double(PHASE_NOISE_MAX_WARMUP)));
+        }
+        warmup = std::min(offset, warmup);
+
+        noise.seek(offset-warmup);
+        prev = 0.0f;
+        for (uint64_t i = 0; i < warmup; i += IMPAIRMENT_CHUNK_SIZE)
+        {
+            this->filter(size_t(std::min<uint64_t>(warmup-i, IMPAIRMENT_CHUNK_SIZE)));
+        }
+    }
+
+    //fill rotations for the next chunk of up to IMPAIRMENT_CHUNK_SIZE samples
+    void rotations(gr_complex *rot, const size_t num)
+    {
+        this->filter(num);
+
+        //the rotations vectorize over the batch of phases
+        float *out = reinterpret_cast<float *>(rot);
+        for (size_t i = 0; i < num; i++)
+        {
+            fastSinCos(phases[i], out[2*i+0], out[2*i+1]);
+        }
+    }
+
+    //noise into phases, then the sequential filter in place
+    void filter(const size_t num)
+    {
+        noise.fill(phases.data(), num);
+        const float oneMinusAlpha = 1.0f-alpha;
+        const float gain = alpha*amplitude;
+        for (size_t i = 0; i < num; i++)
+        {
+            prev = gain*phases[i] + oneMinusAlpha*prev;
+            phases[i] = prev;
+        }
+    }
+
+    float amplitude;
+    float alpha;
+    float prev;
+    GaussianNoise noise;
+    std::vector<float> phases;
+};
+
+/***********************************************************************
+ * Memoryless distortion from gr-channels distortion_2_gen/distortion_3_gen
+ * on split I and Q, so that loops over them have no complex multiplies
+ **********************************************************************/
+//! y = x + gamma*(x*x + x*conj(x)) = x*(1 + gamma*2*Re(x))
+inline void distortion2(float &I, float &Q, const float gammaRe, const float gammaIm)
+{
+    const float u = 2*I;
+    const float gRe = 1.0f + gammaRe*u, gIm = gammaIm*u;
+    const float yI = I*gRe - Q*gIm;
+    Q = I*gIm + Q*gRe;
+    I = yI;
+}
+
+//! y = x + beta*x*|x|^2 = x*(1 + beta*|x|^2)
+inline void distortion3(float &I, float &Q, const float betaRe, const float betaIm)
+{
+    const float u = I*I + Q*Q;
+    const float gRe = 1.0f + betaRe*u, gIm = betaIm*u;
+    const float yI = I*gRe - Q*gIm;
+    Q = I*gIm + Q*gRe;
+    I = yI;
+}
+
+/***********************************************************************
+ * Memoryless polynomial nonlinearity: y = x*G(u), G(u) = sum(c[k]*u^k)
+ *
+ * The drive u is either the envelope |x|, where complex coefficients
+ * give the AM-AM and AM-PM responses, or the in-phase term 2*Re(x).
+ * distortion_3_gen is G = 1 + beta*|x|^2 and distortion_2_gen is
+ * G = 1 + beta*2*Re(x).
+ **********************************************************************/
+struct Polynomial
+{
+    enum Drive {ENVELOPE, IN_PHASE};
+
+    Polynomial(const std::vector<gr_complex> &coeffs, const Drive drive):
+        u(IMPAIRMENT_CHUNK_SIZE),
+        gRe(IMPAIRMENT_CHUNK_SIZE),
+        gIm(IMPAIRMENT_CHUNK_SIZE)
+    {
+        this->setCoefficients(coeffs, drive);
+    }
+
+    //When an envelope polynomial only has even powers it is evaluated
+    //in |x|^2 instead, which saves a sqrt per sample.
+    void setCoefficients(const std::vector<gr_complex> &coeffs, const Drive drive)
+    {
+        bool evenOnly = (drive == ENVELOPE);
+        for (size_t k = 1; k < coeffs.size(); k += 2)
+        {
+            if (coeffs[k] != gr_complex(0.0f)) evenOnly = false;
+        }
+
+        squared = evenOnly;
+        this->drive = drive;
+        cRe.clear();
+        cIm.clear();
+        for (size_t k = 0; k < coeffs.size(); k += evenOnly? 2 : 1)
+        {
+            cRe.push_back(coeffs[k].real());
+            cIm.push_back(coeffs[k].imag());
+        }
+        if (cRe.empty())
+        {
+            cRe.push_back(0.0f);
+            cIm.push_back(0.0f);
+        }
+    }
+
+    void apply(const gr_complex *in, gr_complex *out, const size_t num)
+    {
+        for (size_t i = 0; i < num; i += IMPAIRMENT_CHUNK_SIZE)
+        {
+            this->applyChunk(in+i, out+i, std::min(num-i, IMPAIRMENT_CHUNK_SIZE));
+        }
+    }
+
+    //Each stage is a loop over the chunk so that the loops vectorize
+    //for any order, instead of a per-sample loop over the coefficients.
+    void applyChunk(const gr_complex *in, gr_complex *out, const size_t num)
+    {
+        const float *x = reinterpret_cast<const float *>(in);
+        float *y = reinterpret_cast<float *>(out);
+        const size_t order = cRe.size()-1;
+
+        for (size_t i = 0; i < num; i++)
+        {
+            const float I = x[2*i+0], Q = x[2*i+1];
+            if (drive == IN_PHASE) u[i] = 2*I;
+            else if (squared) u[i] = I*I + Q*Q;
+            else u[i] = std::sqrt(I*I + Q*Q);
+            gRe[i] = cRe[order];
+            gIm[i] = cIm[order];
+        }
+
+        for (size_t k = order; k-- > 0;)
+        {
+            const float re = cRe[k], im = cIm[k];
+            for (size_t i = 0; i < num; i++)
+            {
+                gRe[i] = gRe[i]*u[i] + re;
+                gIm[i] = gIm[i]*u[i] + im;
+            }
+        }
+
+        for (size_t i = 0; i < num; i++)
+        {
+            const float I = x[2*i+0], Q = x[2*i+1];
+            y[2*i+0] = I*gRe[i] - Q*gIm[i];
+            y[2*i+1] = I*gIm[i] + Q*gRe[i];
+        }
+    }
+
+    Drive drive;
+    bool squared;
+    std::vector<float> cRe, cIm;
+    std::vector<float> u, gRe, gIm;
+};
+
+/***********************************************************************
+ * IQ imbalance as a real 2x2 matrix applied to [I, Q]
+ **********************************************************************/
+struct IQMatrix
+{
+    float ii, iq, qi, qq;
+
+    IQMatrix(void):
+        ii(1.0f), iq(0.0f), qi(0.0f), qq(1.0f)
+    {
+        return;
+    }
+
+    /*!
+     * The gr-channels iqbal_gen model, magnitude in dB, phase in degrees.
+     * Receiver: I' = mag*(cos*I + sin*Q), Q' = Q
+     * Transmitter: I' = mag*cos*I, Q' = mag*sin*I + Q
+     */
+    static IQMatrix iqbal(const bool transmitter, const float magnitude, const float phase)
+    {
+        const float mag = dbToAmplitude(magnitude);
+        const float c = std::cos(phase*M_PI/180.0f);
+        const float s = std::sin(phase*M_PI/180.0f);
+        IQMatrix m;
+        m.ii = mag*c;
+        m.iq = transmitter? 0.0f : mag*s;
+        m.qi = transmitter? mag*s : 0.0f;
+        m.qq = 1.0f;
+        return m;
+    }
+
+    gr_complex operator()(const gr_complex &x) const
+    {
+        return gr_complex(ii*x.real() + iq*x.imag(), qi*x.real() + qq*x.imag());
+    }
+
+    //apply to a buffer, written on floats so the loop auto-vectorizes
+    void apply(const gr_complex *in, gr_complex *out, const size_t num) const
+    {
+        const float *x = reinterpret_cast<const float *>(in);
+        float *y = reinterpret_cast<float *>(out);
+        for (size_t i = 0; i < num; i++)
+        {
+            const float I = x[2*i+0], Q = x[2*i+1];
+            y[2*i+0] = ii*I + iq*Q;
+            y[2*i+1] = qi*I + qq*Q;
+        }
+    }
+};
+
+/***********************************************************************
+ * The memoryless stages of the impairments blocks in a single loop:
+ * y = iqbal(distortion2(distortion3(x*rot))) + dc
+ * Written on floats like IQMatrix::apply, so the loop vectorizes
+ * without calls into the library complex multiply.
+ **********************************************************************/
+struct ImpairmentStages
+{
+    ImpairmentStages(void):
+        beta(0.0f),
+        gamma(0.0f),
+        dc(0.0f)
+    {
+        return;
+    }
+
+    //in may equal out, rot is the phase noise rotation per sample
+    void apply(const gr_complex *in, const gr_complex *rot, gr_complex *out, const size_t num) const
+    {
+        const float *x = reinterpret_cast<const float *>(in);
+        const float *r = reinterpret_cast<const float *>(rot);
+        float *y = reinterpret_cast<float *>(out);
+        const float betaRe = beta.real(), betaIm = beta.imag();
+        const float gammaRe = gamma.real(), gammaIm = gamma.imag();
+        const float dcI = dc.real(), dcQ = dc.imag();
+        for (size_t i = 0; i < num; i++)
+        {
+            const float xI = x[2*i+0], xQ = x[2*i+1];
+            const float rI = r[2*i+0], rQ = r[2*i+1];
+            float I = xI*rI - xQ*rQ;
+            float Q = xI*rQ + xQ*rI;
+            distortion3(I, Q, betaRe, betaIm);
+            distortion2(I, Q, gammaRe, gammaIm);
+            y[2*i+0] = iqbal.ii*I + iqbal.iq*Q + dcI;
+            y[2*i+1] = iqbal.qi*I + iqbal.qq*Q + dcQ;
+        }
+    }
+
+    gr_complex beta;
+    gr_complex gamma;
+    gr_complex dc;
+    IQMatrix iqbal;
+};
+
+/***********************************************************************
+ * Quantizer: scale, saturate to the int16 range, round, and rescale
+ * which is what the float_to_short/short_to_float pair computes
+ **********************************************************************/
+struct Quantizer
+{
+    Quantizer(const size_t bits)
+    {
+        this->setBits(bits);
+    }
+
+    void setBits(const size_t bits)
+    {
+        scale = std::pow(2.0f, static_cast<float>(bits)-1);
+        invScale = 1.0f/scale;
+    }
+
+    //Works on floats so complex buffers pass in 2x the element count.
+    //The clamp keeps values well under 2^22, so adding and subtracting
+    //1.5*2^23 rounds to nearest even like lrintf, without a conversion.
+    void apply(const float *in, float *out, const size_t num) const
+    {
+        static const float roundMagic = 12582912.0f;
+        for (size_t i = 0; i < num; i++)
+        {
+            const float v = std::min(std::max(in[i]*scale, -32768.0f), 32767.0f);
+            out[i] = ((v + roundMagic) - roundMagic)*invScale;
+        }
+    }
+
+    float scale;
+    float invScale;
+};
+
+/***********************************************************************
+ * Blind IQ correction from gr-channels amp_bal/phase_bal
+ *
+ * The running averages are single pole IIRs with gain alpha, held in
+ * locals for the duration of a call. AmplitudeBalance decays both powers
+ * on a zero sample, and keeps a ratio of 1 while the Q power is zero.
+ * PhaseBalance skips samples with no power, whose normalized estimate
+ * would be a NaN, and leaves its average alone.
+ **********************************************************************/
+struct AmplitudeBalance
+{
+    AmplitudeBalance(const double alpha):
+        alpha(alpha),
+        powerI(0.0),
+        powerQ(0.0)
+    {
+        return;
+    }
+
+    //! Ratio of the running I and Q RMS that Q is scaled by
+    float ratio(void) const
+    {
+        return (powerQ > 0.0)? float(std::sqrt(powerI/powerQ)) : 1.0f;
+    }
+
+    void apply(const gr_complex *in, gr_complex *out, const size_t num)
+    {
+        const double beta = 1.0-alpha;
+        double pI = powerI, pQ = powerQ;
+        for (size_t i = 0; i < num; i++)
+        {
+            const float I = in[i].real(), Q = in[i].imag();
+            pI = beta*pI + alpha*I*I;
+            pQ = beta*pQ + alpha*Q*Q;
+            const float r = (pQ > 0.0)? float(std::sqrt(pI/pQ)) : 1.0f;
+            out[i] = gr_complex(I, Q*r);
+        }
+        powerI = pI;
+        powerQ = pQ;
+    }
+
+    double alpha;
+    double powerI;
+    double powerQ;
+};
+
+struct PhaseBalance
+{
+    PhaseBalance(const double alpha):
+        alpha(alpha),
+        estimate(0.0)
+    {
+        return;
+    }
+
+    void apply(const gr_complex *in, gr_complex *out, const size_t num)
+    {
+        const double beta = 1.0-alpha;
+        double est = estimate;
+        for (size_t i = 0; i < num; i++)
+        {
+            const float I = in[i].real(), Q = in[i].imag();
+            const float power = I*I + Q*Q;
+            if (power > 0.0f) est = beta*est + alpha*(2.0f*I*Q/power);
+            const float e = float(est);
+            out[i] = gr_complex(I - e*Q, Q - e*I);
+        }
+        estimate = est;
+    }
+
+    double alpha;
+    double estimate;
+};
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Pothos/Testing.hpp>
+
+#include <gnuradio/types.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+ * Helpers for the known answer tests of the native channel blocks.
+ *
+ * runChannelBlock() feeds one buffer into each input port, collects each
+ * output port, and returns the collected outputs once the topology is
+ * inactive.
+ */
+
+template <typename OutType, typename InType>
+std::vector<std::vector<OutType>> runChannelBlock(
+    const Pothos::Proxy &block,
+    const std::vector<std::vector<InType>> &inputs,
+    const size_t numOutputs)
+{
+    Pothos::Topology topology;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", Pothos::DType(typeid(InType)));
+        Pothos::BufferChunk buff(Pothos::DType(typeid(InType)), inputs[i].size());
+        std::copy(inputs[i].begin(), inputs[i].end(), buff.as<InType *>());
+        feeder.call("feedBuffer", buff);
+        topology.connect(feeder, 0, block, std::to_string(i));
+    }
+
+    std::vector<Pothos::Proxy> collectors;
+    for (size_t i = 0; i < numOutputs; i++)
+    {
+        collectors.push_back(Pothos::BlockRegistry::make("/blocks/collector_sink", Pothos::DType(typeid(OutType))));
+        topology.connect(block, std::to_string(i), collectors.back(), 0);
+    }
+
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive());
+
+    std::vector<std::vector<OutType>> outputs;
+    for (const auto &collector : collectors)
+    {
+        const auto buff = collector.call<Pothos::BufferChunk>("getBuffer");
+        const auto begin = buff.as<const OutType *>();
+        outputs.emplace_back(begin, begin+buff.elements());
+    }
+    return outputs;
+}
+
+//! Single input and output version
+template <typename OutType, typename InType>
+std::vector<OutType> runChannelBlock(const Pothos::Proxy &block, const std::vector<InType> &input)
+{
+    return runChannelBlock<OutType, InType>(block, std::vector<std::vector<InType>>{input}, 1).front();
+}
+
+inline void testChannelClose(const std::vector<float> &expected, const std::vector<float> &actual, const float tolerance)
+{
+    POTHOS_TEST_EQUAL(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        POTHOS_TEST_CLOSE(expected[i], actual[i], tolerance);
+    }
+}
+
+inline void testChannelClose(const std::vector<gr_complex> &expected, const std::vector<gr_complex> &actual, const float tolerance)
+{
+    POTHOS_TEST_EQUAL(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        POTHOS_TEST_CLOSE(expected[i].real(), actual[i].real(), tolerance);
+        POTHOS_TEST_CLOSE(expected[i].imag(), actual[i].imag(), tolerance);
+    }
+}
@@ -19,26 +19,41 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
 
 #include <gnuradio/types.h>
 
-#include <cmath>
+#include <algorithm>
 #include <vector>
 
 /*
  * Ported from: gr-channels/python/impairments.py
+ *
+ * The hierarchical block mixes down by the frequency offset, applies
+ * phase noise, third and second order distortion, receiver IQ imbalance
+ * and the DC offset, then mixes back up. Rather than a topology of
+ * blocks, all stages are applied to each chunk of samples in one pass.
  */
 
-static constexpr size_t vlen = 1;
+static constexpr float phaseNoiseAlpha = 0.01f;
+static constexpr uint64_t phaseNoiseSeed = 42;
 
-class impairments: public Pothos::Topology
+#define REGISTER_GETTER_SETTER(field_name) \
+    this->registerCall(this, POTHOS_FCN_TUPLE(impairments, field_name)); \
+    this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_ ## field_name)); \
+    this->registerProbe(#field_name, #field_name "_triggered", "probe_" #field_name);
+
+class impairments: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(
+    static Pothos::Block* make(
         float noise_mag,
         float iqbal_mag,
         float iqbal_phase,
@@ -50,7 +65,7 @@ public:
     {
         return new impairments(noise_mag, iqbal_mag, iqbal_phase, i_offset, q_offset, freq_offset, beta, gamma);
     }
-  
+
     impairments(float noise_mag,
                 float iqbal_mag,
                 float iqbal_phase,
@@ -59,168 +74,187 @@ public:
                 float freq_offset,
                 const gr_complex& beta,
                 const gr_complex& gamma):
-        Pothos::Topology(),
-        d_phase_noise_gen0(Pothos::BlockRegistry::make("/gr/channels/phase_noise_gen", 0.0f, 0.01)),
-        d_iqbal_gen0(Pothos::BlockRegistry::make("/gr/channels/iqbal_gen", "RECEIVER")),
-        d_distortion_2_gen0(Pothos::BlockRegistry::make("/gr/channels/distortion_2_gen", gamma)),
-        d_distortion_3_gen0(Pothos::BlockRegistry::make("/gr/channels/distortion_3_gen", beta)),
-        d_multiply_cc0(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_cc", vlen)),
-        d_multiply_cc1(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_cc", vlen)),
-        d_conjugate_cc0(Pothos::BlockRegistry::make("/gr/blocks/conjugate_cc")),
-        d_add_const_cc0(Pothos::BlockRegistry::make("/gr/blocks/add_const", "add_const_cc", gr_complex(i_offset, q_offset))),
-        d_sig_source_c0(Pothos::BlockRegistry::make("/gr/analog/sig_source", "sig_source_c", 1.0f, "GR_COS_WAVE", freq_offset, 1, 0)),
-        d_noise_mag_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(float)))),
-        d_i_offset_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(float)))),
-        d_q_offset_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(float)))),
-        d_noise_mag_eval(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"mag"})),
-        d_iq_offset_eval(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"iOffset","qOffset"}))
+        Pothos::Block(),
+        d_iqbal_mag(iqbal_mag),
+        d_iqbal_phase(iqbal_phase),
+        d_freq_offset(freq_offset),
+        d_noise_mag(noise_mag),
+        d_phase_noise(dbToAmplitude(noise_mag), phaseNoiseAlpha, phaseNoiseSeed),
+        d_rotations(IMPAIRMENT_CHUNK_SIZE)
     {
-        this->connect(d_phase_noise_gen0, 0, d_distortion_3_gen0, 0);
-        this->connect(d_multiply_cc0, 0, this, 0);
-        this->connect(d_add_const_cc0, 0, d_multiply_cc0, 1);
-        this->connect(d_sig_source_c0, 0, d_multiply_cc0, 0);
-        this->connect(d_multiply_cc1, 0, d_phase_noise_gen0, 0);
-        this->connect(d_sig_source_c0, 0, d_conjugate_cc0, 0);
-        this->connect(this, 0, d_multiply_cc1, 1);
-        this->connect(d_conjugate_cc0, 0, d_multiply_cc1, 0);
-        this->connect(d_iqbal_gen0, 0, d_add_const_cc0, 0);
-        this->connect(d_distortion_3_gen0, 0, d_distortion_2_gen0, 0);
-        this->connect(d_distortion_2_gen0, 0, d_iqbal_gen0, 0);
-        
-        // Add calls or connect to internal calls
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, noise_mag));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_noise_mag));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, iqbal_mag));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_iqbal_mag));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, iqbal_phase));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_iqbal_phase));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, i_offset));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_i_offset));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, q_offset));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_q_offset));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, freq_offset));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_freq_offset));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, beta));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_beta));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, gamma));
-        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, set_gamma));
-
-        // Setter connections
-        this->connect(this, "set_noise_mag", d_noise_mag_constant_source, "setConstant");
-        this->connect(this, "set_iqbal_mag", d_iqbal_gen0, "set_magnitude");
-        this->connect(this, "set_iqbal_phase", d_iqbal_gen0, "set_phase");
-        this->connect(this, "set_i_offset", d_i_offset_constant_source, "setConstant");
-        this->connect(this, "set_q_offset", d_q_offset_constant_source, "setConstant");
-        this->connect(this, "set_freq_offset", d_sig_source_c0, "set_frequency");
-        this->connect(this, "set_beta", d_distortion_3_gen0, "set_beta");
-        this->connect(this, "set_gamma", d_distortion_2_gen0, "set_beta");
-
-        // Normal probe connections
-        this->connect(this, "probe_noise_mag", d_noise_mag_constant_source, "probeConstant");
-        this->connect(this, "probe_iqbal_mag", d_iqbal_gen0, "probe_magnitude");
-        this->connect(this, "probe_iqbal_phase", d_iqbal_gen0, "probe_phase");
-        this->connect(this, "probe_i_offset", d_i_offset_constant_source, "probeConstant");
-        this->connect(this, "probe_q_offset", d_q_offset_constant_source, "probeConstant");
-        this->connect(this, "probe_freq_offset", d_sig_source_c0, "probe_frequency");
-        this->connect(this, "probe_beta", d_distortion_3_gen0, "probe_beta");
-        this->connect(this, "probe_gamma", d_distortion_2_gen0, "probe_beta");
-        this->connect(d_noise_mag_constant_source, "constantTriggered", this, "noise_mag_triggered");
-        this->connect(d_iqbal_gen0, "magnitude_triggered", this, "iqbal_mag_triggered");
-        this->connect(d_iqbal_gen0, "phase_triggered", this, "iqbal_phase_triggered");
-        this->connect(d_i_offset_constant_source, "constantTriggered", this, "i_offset_triggered");
-        this->connect(d_q_offset_constant_source, "constantTriggered", this, "q_offset_triggered");
-        this->connect(d_sig_source_c0, "frequency_triggered", this, "freq_offset_triggered");
-        this->connect(d_distortion_3_gen0, "beta_triggered", this, "beta_triggered");
-        this->connect(d_distortion_2_gen0, "beta_triggered", this, "gamma_triggered");
-
-        // Set up evaluator blocks
-        d_noise_mag_eval.call("setExpression", "pow(10.0,mag/20.0)");
-        this->connect(d_noise_mag_constant_source, "constantChanged", d_noise_mag_eval, "setMag");
-        this->connect(d_noise_mag_eval, "triggered", d_phase_noise_gen0, "set_noise_mag");
-        
-        d_iq_offset_eval.call("setExpression", "complex(iOffset,qOffset)");
-        this->connect(d_i_offset_constant_source, "constantChanged", d_iq_offset_eval, "setIOffset");
-        this->connect(d_q_offset_constant_source, "constantChanged", d_iq_offset_eval, "setQOffset");
-        this->connect(d_iq_offset_eval, "triggered", d_add_const_cc0, "set_k");
-
-        // Call non-constructor setters after probes are set
-        d_noise_mag_constant_source.call("setConstant", noise_mag);
-        d_i_offset_constant_source.call("setConstant", i_offset);
-        d_q_offset_constant_source.call("setConstant", q_offset);
-        d_iqbal_gen0.call("set_magnitude", iqbal_mag);
-        d_iqbal_gen0.call("set_phase", iqbal_phase);
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
+
+        REGISTER_GETTER_SETTER(noise_mag)
+        REGISTER_GETTER_SETTER(iqbal_mag)
+        REGISTER_GETTER_SETTER(iqbal_phase)
+        REGISTER_GETTER_SETTER(i_offset)
+        REGISTER_GETTER_SETTER(q_offset)
+        REGISTER_GETTER_SETTER(freq_offset)
+        REGISTER_GETTER_SETTER(beta)
+        REGISTER_GETTER_SETTER(gamma)
+        REGISTER_GETTER_SETTER(stream_id)
+        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, position));
+        this->registerCall(this, POTHOS_FCN_TUPLE(impairments, seek));
+
+        this->set_iqbal_mag(iqbal_mag);
+        this->set_i_offset(i_offset);
+        this->set_q_offset(q_offset);
+        this->set_freq_offset(freq_offset);
+        this->set_beta(beta);
+        this->set_gamma(gamma);
     }
 
     float noise_mag() const
     {
-        return d_noise_mag_constant_source.call("getConstant");
+        return d_noise_mag;
+    }
+
+    void set_noise_mag(float noise_mag)
+    {
+        d_noise_mag = noise_mag;
+        d_phase_noise.amplitude = dbToAmplitude(noise_mag);
     }
 
     float iqbal_mag() const
     {
-        return d_iqbal_gen0.call("magnitude");
+        return d_iqbal_mag;
+    }
+
+    void set_iqbal_mag(float iqbal_mag)
+    {
+        d_iqbal_mag = iqbal_mag;
+        d_stages.iqbal = IQMatrix::iqbal(false/*receiver*/, d_iqbal_mag, d_iqbal_phase);
     }
 
     float iqbal_phase() const
     {
-        return d_iqbal_gen0.call("phase");
+        return d_iqbal_phase;
+    }
+
+    void set_iqbal_phase(float iqbal_phase)
+    {
+        d_iqbal_phase = iqbal_phase;
+        d_stages.iqbal = IQMatrix::iqbal(false/*receiver*/, d_iqbal_mag, d_iqbal_phase);
     }
 
     float i_offset() const
     {
-        return d_i_offset_constant_source.call("getConstant");
+        return d_stages.dc.real();
+    }
+
+    void set_i_offset(float i_offset)
+    {
+        d_stages.dc.real(i_offset);
     }
 
     float q_offset() const
     {
-        return d_q_offset_constant_source.call("getConstant");
+        return d_stages.dc.imag();
+    }
+
+    void set_q_offset(float q_offset)
+    {
+        d_stages.dc.imag(q_offset);
     }
 
     float freq_offset() const
     {
-        return d_sig_source_c0.call("frequency");
+        return d_freq_offset;
+    }
+
+    void set_freq_offset(float freq_offset)
+    {
+        d_freq_offset = freq_offset;
+        d_lo.setFrequency(freq_offset);
     }
 
     gr_complex beta() const
     {
-        return d_distortion_3_gen0.call("beta");
+        return d_stages.beta;
+    }
+
+    void set_beta(const gr_complex& beta)
+    {
+        d_stages.beta = beta;
     }
 
     gr_complex gamma() const
     {
-        return d_distortion_2_gen0.call("beta");
+        return d_stages.gamma;
+    }
+
+    void set_gamma(const gr_complex& gamma)
+    {
+        d_stages.gamma = gamma;
+    }
+
+    //! The noise stream, instances with different IDs are independent
+    unsigned long long stream_id() const
+    {
+        return d_phase_noise.noise.stream;
     }
 
-    // These need to be here to connect to internal blocks.
-    void set_noise_mag(float) {}
-    void set_iqbal_mag(float) {}
-    void set_iqbal_phase(float) {}
-    void set_i_offset(float) {}
-    void set_q_offset(float) {}
-    void set_freq_offset(float) {}
-    void set_beta(const gr_complex& beta) {}
-    void set_gamma(const gr_complex& gamma) {}
+    void set_stream_id(unsigned long long stream_id)
+    {
+        d_phase_noise.noise.stream = stream_id;
+    }
+
+    //! The sample offset of the next output in the noise stream
+    unsigned long long position() const
+    {
+        return d_phase_noise.noise.position;
+    }
+
+    void seek(unsigned long long offset)
+    {
+        d_phase_noise.seek(offset);
+    }
+
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        const auto in = inPort->buffer().as<const gr_complex *>();
+        const auto out = outPort->buffer().as<gr_complex *>();
+
+        //setters run between calls to work, so the parameters are fixed here
+        const bool mixing = not d_lo.isIdentity();
+        for (size_t i = 0; i < num; i += IMPAIRMENT_CHUNK_SIZE)
+        {
+            const size_t n = std::min(num-i, IMPAIRMENT_CHUNK_SIZE);
+            const gr_complex *x = in+i;
+            gr_complex *y = out+i;
+
+            if (mixing)
+            {
+                d_lo.mixDown(x, y, n);
+                x = y;
+            }
+
+            d_phase_noise.rotations(d_rotations.data(), n);
+            d_stages.apply(x, d_rotations.data(), y, n);
+
+            if (mixing) d_lo.mixUp(y, y, n);
+        }
+
+        inPort->consume(num);
+        outPort->produce(num);
+    }
 
 private:
+    float d_iqbal_mag;
+    float d_iqbal_phase;
+    float d_freq_offset;
+    float d_noise_mag;
 
-    Pothos::Proxy d_phase_noise_gen0;
-    Pothos::Proxy d_iqbal_gen0;
-    Pothos::Proxy d_distortion_2_gen0;
-    Pothos::Proxy d_distortion_3_gen0;
-    Pothos::Proxy d_multiply_cc0;
-    Pothos::Proxy d_multiply_cc1;
-    Pothos::Proxy d_conjugate_cc0;
-    Pothos::Proxy d_add_const_cc0; // Was vcc for no reason
-    Pothos::Proxy d_sig_source_c0;
-
-    // Constant sources to abuse as variables
-    Pothos::Proxy d_noise_mag_constant_source;
-    Pothos::Proxy d_i_offset_constant_source;
-    Pothos::Proxy d_q_offset_constant_source;
-
-    // Eval blocks to process given constants without storing them
-    Pothos::Proxy d_noise_mag_eval;
-    Pothos::Proxy d_iq_offset_eval;
+    ImpairmentStages d_stages;
+    Oscillator d_lo;
+    PhaseNoise d_phase_noise;
+    std::vector<gr_complex> d_rotations;
 };
 
 /***********************************************************************
@@ -229,10 +263,12 @@ private:
  * Emulate various impairments on the given input signal. This block
  * applies the following:
  * <ul>
+ * <li>Frequency offset</li>
  * <li>IQ imbalance</li>
  * <li>Phase noise</li>
  * <li>Second-order distortion</li>
  * <li>Third-order distortion</li>
+ * <li>DC offset</li>
  * </ul>
  *
  * |category /GNURadio/Impairments
@@ -279,8 +315,55 @@ private:
  * |default 0.0
  * |preview enable
  *
+ * |param stream_id[Noise Stream] The counter-based noise stream.
+ * Blocks with different streams produce independent phase noise.
+ * seek() resumes the stream at any offset, with the filter state
+ * matching a continuous run to within float precision.
+ * |widget SpinBox(minimum=0)
+ * |default 0
+ * |preview valid
+ *
  * |factory /gr/channels/impairments(noise_mag,iqbal_mag,iqbal_phase,i_offset,q_offset,freq_offset,beta,gamma)
+ * |setter set_noise_mag(noise_mag)
+ * |setter set_iqbal_mag(iqbal_mag)
+ * |setter set_iqbal_phase(iqbal_phase)
+ * |setter set_i_offset(i_offset)
+ * |setter set_q_offset(q_offset)
+ * |setter set_freq_offset(freq_offset)
+ * |setter set_beta(beta)
+ * |setter set_gamma(gamma)
+ * |setter set_stream_id(stream_id)
  **********************************************************************/
 static Pothos::BlockRegistry registerImpairments(
     "/gr/channels/impairments",
     Pothos::Callable(&impairments::make));
+
+/***********************************************************************
+ * Known answers from the stages of gr-channels impairments.py in double
+ * precision. The phase noise is -200 dB, so the rotation is complex(0, 1).
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_impairments_known_answers)
+{
+    const std::vector<gr_complex> input{
+        gr_complex(0.5f, 0.25f), gr_complex(-0.3f, 0.1f),
+        gr_complex(0.0f, -0.6f), gr_complex(0.8f, 0.0f)};
+
+    auto impairments = Pothos::BlockRegistry::make("/gr/channels/impairments",
+        -200.0f, 1.0f, 5.0f, 0.01f, -0.02f, 0.0f,
+        gr_complex(-0.05f, 0.02f), gr_complex(-0.03f, 0.01f));
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(-0.2211787f, 0.4792036f),
+        gr_complex(-0.1312259f, -0.3202769f),
+        gr_complex(0.6463252f, -0.0088896f),
+        gr_complex(0.0745001f, 0.7548779f)},
+        runChannelBlock<gr_complex>(impairments, input), 1e-5f);
+
+    //a quarter cycle offset: the stages run between the mix down and up
+    impairments.call("set_freq_offset", 0.25f);
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(-0.2211787f, 0.4792036f),
+        gr_complex(-0.0824569f, -0.3191755f),
+        gr_complex(0.6716750f, 0.0175296f),
+        gr_complex(-0.0187219f, 0.8958555f)},
+        runChannelBlock<gr_complex>(impairments, input), 1e-5f);
+}
@@ -19,171 +19,137 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
 
 #include <gnuradio/types.h>
 
-#include <cmath>
-#include <iostream>
+#include <algorithm>
 #include <string>
 
 /*
  * Ported from: gr-channels/python/iqbal_gen.py
+ *
+ * The hierarchical block splits the samples into I and Q, scales and
+ * sums them with multiply_const_ff and add_ff blocks, and recombines
+ * them. Both modes are a real 2x2 matrix on [I, Q], which is applied
+ * here in a single loop over the samples.
  */
 
-static constexpr size_t vlen = 1;
-
-static float convertMag(float mag)
-{
-    return std::pow(10.0f, (mag / 20.0f));
-}
-
-static float convertPhaseCos(float phase)
-{
-    return std::cos(phase * M_PI / 180.0f);
-}
-
-static float convertPhaseSin(float phase)
-{
-    return std::sin(phase * M_PI / 180.0f);
-}
-
-class iqbal_gen: public Pothos::Topology
+class iqbal_gen: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(const std::string& mode)
+    static Pothos::Block* make(const std::string& mode)
     {
         return new iqbal_gen(mode);
     }
-    
+
     iqbal_gen(const std::string& mode):
-        Pothos::Topology(),
-        d_mag(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_ff", convertMag(0.0f), vlen)),
-        d_sin_phase(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_ff", convertPhaseSin(0.0f), vlen)),
-        d_cos_phase(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_ff", convertPhaseCos(0.0f), vlen)),
-        d_f2c(Pothos::BlockRegistry::make("/gr/blocks/float_to_complex", vlen)),
-        d_c2f(Pothos::BlockRegistry::make("/gr/blocks/complex_to_float", vlen)),
-        d_adder(Pothos::BlockRegistry::make("/gr/blocks/add", "add_ff", vlen)),
-        d_mag_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(float)))),
-        d_phase_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(float)))),
-        d_mag_eval(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"x"})),
-        d_sin_phase_eval(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"x"})),
-        d_cos_phase_eval(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"x"}))
+        Pothos::Block(),
+        d_transmitter(mode == "TRANSMITTER"),
+        d_magnitude(0.0f),
+        d_phase(0.0f)
     {
-        // Assemble flowgraph based on mode
-        if(mode == "TRANSMITTER")
-        {
-            this->connect(this, 0, d_c2f, 0);
-            this->connect(d_c2f, 0, d_mag, 0);
-            this->connect(d_mag, 0, d_cos_phase, 0);
-            this->connect(d_cos_phase, 0, d_f2c, 0);
-            this->connect(d_mag, 0, d_sin_phase, 0);
-            this->connect(d_sin_phase, 0, d_adder, 0);
-            this->connect(d_c2f, 1, d_adder, 1);
-            this->connect(d_adder, 0, d_f2c, 1);
-            this->connect(d_f2c, 0, this, 0);
-        }
-        else if(mode == "RECEIVER")
-        {
-            this->connect(this, 0, d_c2f, 0);
-            this->connect(d_c2f, 0, d_cos_phase, 0);
-            this->connect(d_cos_phase, 0, d_adder, 0);
-            this->connect(d_c2f, 0, d_sin_phase, 0);
-            this->connect(d_sin_phase, 0, d_adder, 1);
-            this->connect(d_adder, 0, d_mag, 0);
-            this->connect(d_mag, 0, d_f2c, 0);
-            this->connect(d_c2f, 0, d_f2c, 1);
-            this->connect(d_f2c, 0, this, 0);
-        }
-        else
+        if(mode != "TRANSMITTER" and mode != "RECEIVER")
         {
             throw Pothos::InvalidArgumentException("iq_bal_gen", "Invalid mode "+mode);
         }
 
-        // Add calls
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
+
         this->registerCall(this, POTHOS_FCN_TUPLE(iqbal_gen, magnitude));
         this->registerCall(this, POTHOS_FCN_TUPLE(iqbal_gen, set_magnitude));
         this->registerCall(this, POTHOS_FCN_TUPLE(iqbal_gen, phase));
         this->registerCall(this, POTHOS_FCN_TUPLE(iqbal_gen, set_phase));
+        this->registerCall(this, POTHOS_FCN_TUPLE(iqbal_gen, set_magnitude_phase));
+        this->registerProbe("magnitude", "magnitude_triggered", "probe_magnitude");
+        this->registerProbe("phase", "phase_triggered", "probe_phase");
+        this->registerSignal("magnitude_changed");
+        this->registerSignal("phase_changed");
 
-        // Connections to emulate probes
-        this->connect(this, "set_magnitude", d_mag_constant_source, "setConstant");
-        this->connect(this, "probe_magnitude", d_mag_constant_source, "probeConstant");
-        this->connect(d_mag_constant_source, "constantTriggered", this, "magnitude_triggered");
-        this->connect(d_mag_constant_source, "constantChanged", this, "magnitude_changed");
-
-        this->connect(this, "set_phase", d_phase_constant_source, "setConstant");
-        this->connect(this, "probe_phase", d_phase_constant_source, "probeConstant");
-        this->connect(d_phase_constant_source, "constantTriggered", this, "phase_triggered");
-        this->connect(d_phase_constant_source, "constantChanged", this, "phase_changed");
-
-        // Note: muparserx has a global pi constant
-        set_up_probe_hack(d_mag_constant_source, d_mag_eval, d_mag, "pow(10.0,(x/20.0))");
-        set_up_probe_hack(d_phase_constant_source, d_sin_phase_eval, d_sin_phase, "sin(x*pi/180.0)");
-        set_up_probe_hack(d_phase_constant_source, d_cos_phase_eval, d_cos_phase, "cos(x*pi/180.0)");
+        this->update();
     }
 
     float magnitude() const
     {
-        return d_mag_constant_source.call("constant");
+        return d_magnitude;
     }
 
-    // We need this here for block connections.
-    void set_magnitude(float) {}
+    void set_magnitude(float magnitude)
+    {
+        d_magnitude = magnitude;
+        this->update();
+        this->emitSignal("magnitude_changed", magnitude);
+    }
 
     float phase() const
     {
-        return d_phase_constant_source.call("constant");
+        return d_phase;
+    }
+
+    void set_phase(float phase)
+    {
+        d_phase = phase;
+        this->update();
+        this->emitSignal("phase_changed", phase);
+    }
+
+    // Both parameters change together, no samples see only one of them.
+    void set_magnitude_phase(float magnitude, float phase)
+    {
+        d_magnitude = magnitude;
+        d_phase = phase;
+        this->update();
+        this->emitSignal("magnitude_changed", magnitude);
+        this->emitSignal("phase_changed", phase);
     }
 
-    // We need this here for block connections.
-    void set_phase(float) {}
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+
+        // Setters run between calls to work, so the matrix is fixed here.
+        d_matrix.apply(inPort->buffer().as<const gr_complex *>(), outPort->buffer().as<gr_complex *>(), num);
+
+        inPort->consume(num);
+        outPort->produce(num);
+    }
 
 private:
-    // These were vff for no reason.
-    Pothos::Proxy d_mag;
-    Pothos::Proxy d_sin_phase;
-    Pothos::Proxy d_cos_phase;
-
-    Pothos::Proxy d_f2c;
-    Pothos::Proxy d_c2f;
-    Pothos::Proxy d_adder;
-
-    // Terrible hacky way to fake probes in a topology when the
-    // value needs extra processing before being passed into an
-    // internal block.
-    Pothos::Proxy d_mag_constant_source;
-    Pothos::Proxy d_phase_constant_source;
-    Pothos::Proxy d_mag_eval;
-    Pothos::Proxy d_sin_phase_eval;
-    Pothos::Proxy d_cos_phase_eval;
-
-    void set_up_probe_hack(
-        const Pothos::Proxy& constant_source,
-        const Pothos::Proxy& eval,
-        const Pothos::Proxy& multiply_const_ff,
-        const std::string& expression)
+    void update(void)
     {
-        eval.call("setExpression", expression);
-
-        this->connect(
-            constant_source, "constantChanged",
-            eval, "setX");
-        this->connect(
-            eval, "triggered",
-            multiply_const_ff, "set_k");
+        d_matrix = IQMatrix::iqbal(d_transmitter, d_magnitude, d_phase);
     }
-};
 
-// TODO: add mag+phase setters
+    const bool d_transmitter;
+    float d_magnitude;
+    float d_phase;
+    IQMatrix d_matrix;
+};
 
 /***********************************************************************
  * |PothosDoc IQ Imbalance Generator
  *
  * Introduces IQ imbalance to the input signal.
+ * With the magnitude as the linear gain mag and the phase as phi:
+ * <ul>
+ * <li>Transmitter: I' = mag*cos(phi)*I, Q' = mag*sin(phi)*I + Q</li>
+ * <li>Receiver: I' = mag*(cos(phi)*I + sin(phi)*Q), Q' = Q</li>
+ * </ul>
+ * The receiver mode matches gr-channels. Earlier versions of this
+ * block used I in place of Q in receiver mode, for both the sine
+ * term and the Q output.
  *
  * |category /GNURadio/Impairments
  * |keywords rf balance magnitude phase
@@ -195,8 +161,51 @@ private:
  * |default "TRANSMITTER"
  * |preview enable
  *
+ * |param magnitude[Magnitude] Magnitude imbalance
+ * |widget DoubleSpinBox(minimum=0,maximum=10,step=0.1,decimals=1)
+ * |default 0.0
+ * |units dB
+ * |preview enable
+ *
+ * |param phase[Phase] Phase imbalance
+ * |widget DoubleSpinBox(minimum=0,maximum=45,step=0.1,decimals=1)
+ * |default 0.0
+ * |units degrees
+ * |preview enable
+ *
  * |factory /gr/channels/iqbal_gen(mode)
+ * |setter set_magnitude(magnitude)
+ * |setter set_phase(phase)
  **********************************************************************/
 static Pothos::BlockRegistry registerIqBal(
     "/gr/channels/iqbal_gen",
     Pothos::Callable(&iqbal_gen::make));
+
+/***********************************************************************
+ * Known answers for both modes from the equations in the block docs
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_iqbal_gen_known_answers)
+{
+    const std::vector<gr_complex> input{
+        gr_complex(0.5f, 0.25f), gr_complex(-0.3f, 0.1f),
+        gr_complex(0.0f, -0.6f), gr_complex(0.8f, 0.0f)};
+
+    auto transmitter = Pothos::BlockRegistry::make("/gr/channels/iqbal_gen", "TRANSMITTER");
+    transmitter.call("set_magnitude_phase", 2.0f, 10.0f);
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.6198998f, 0.3593051f),
+        gr_complex(-0.3719399f, 0.0344170f),
+        gr_complex(0.0000000f, -0.6000000f),
+        gr_complex(0.9918396f, 0.1748881f)},
+        runChannelBlock<gr_complex>(transmitter, input), 1e-5f);
+
+    //Q passes through, and feeds the I output through the phase
+    auto receiver = Pothos::BlockRegistry::make("/gr/channels/iqbal_gen", "RECEIVER");
+    receiver.call("set_magnitude_phase", 2.0f, 10.0f);
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.6745523f, 0.2500000f),
+        gr_complex(-0.3500788f, 0.1000000f),
+        gr_complex(-0.1311661f, -0.6000000f),
+        gr_complex(0.9918396f, 0.0000000f)},
+        runChannelBlock<gr_complex>(receiver, input), 1e-5f);
+}
@@ -0,0 +1,427 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Object.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
+
+#include <gnuradio/types.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+ * The impairments model for the N channels of a coherent receiver.
+ *
+ * The channels share one local oscillator, so the frequency offset and
+ * phase noise are generated once per chunk and combined into a single
+ * mix down sequence that every channel is multiplied by. The IQ
+ * imbalance and DC offset are per channel, kept as arrays indexed by
+ * channel, and applied in the same loop as the distortion.
+ */
+
+static constexpr float phaseNoiseAlpha = 0.01f;
+static constexpr uint64_t phaseNoiseSeed = 42;
+
+#define REGISTER_GETTER_SETTER(field_name) \
+    this->registerCall(this, POTHOS_FCN_TUPLE(multichannel_impairments, field_name)); \
+    this->registerCall(this, POTHOS_FCN_TUPLE(multichannel_impairments, set_ ## field_name)); \
+    this->registerProbe(#field_name, #field_name "_triggered", "probe_" #field_name);
+
+//a single value applies to every channel, otherwise there must be one per channel
+template <typename T>
+static std::vector<T> perChannel(const std::string &name, const std::vector<T> &values, const size_t numChannels)
+{
+    if (values.size() == numChannels) return values;
+    if (values.size() == 1) return std::vector<T>(numChannels, values.front());
+    throw Pothos::InvalidArgumentException(
+        "multichannel_impairments: "+name+" needs 1 or "+std::to_string(numChannels)+" values",
+        std::to_string(values.size()));
+}
+
+class multichannel_impairments: public Pothos::Block
+{
+public:
+    static Pothos::Block* make(
+        size_t num_channels,
+        float noise_mag,
+        const std::vector<float> &iqbal_mag,
+        const std::vector<float> &iqbal_phase,
+        const std::vector<gr_complex> &dc_offset,
+        float freq_offset,
+        const gr_complex& beta,
+        const gr_complex& gamma)
+    {
+        return new multichannel_impairments(num_channels, noise_mag, iqbal_mag, iqbal_phase, dc_offset, freq_offset, beta, gamma);
+    }
+
+    multichannel_impairments(size_t num_channels,
+                             float noise_mag,
+                             const std::vector<float> &iqbal_mag,
+                             const std::vector<float> &iqbal_phase,
+                             const std::vector<gr_complex> &dc_offset,
+                             float freq_offset,
+                             const gr_complex& beta,
+                             const gr_complex& gamma):
+        Pothos::Block(),
+        d_num_channels(num_channels),
+        d_noise_mag(noise_mag),
+        d_iqbal_mag(perChannel("iqbal_mag", iqbal_mag, num_channels)),
+        d_iqbal_phase(perChannel("iqbal_phase", iqbal_phase, num_channels)),
+        d_stages(num_channels),
+        d_phase_noise(dbToAmplitude(noise_mag), phaseNoiseAlpha, phaseNoiseSeed),
+        d_ones(IMPAIRMENT_CHUNK_SIZE, gr_complex(1.0f)),
+        d_rotations(IMPAIRMENT_CHUNK_SIZE),
+        d_up(IMPAIRMENT_CHUNK_SIZE),
+        d_down(IMPAIRMENT_CHUNK_SIZE)
+    {
+        if (num_channels == 0) throw Pothos::InvalidArgumentException("multichannel_impairments: no channels");
+
+        for (size_t ch = 0; ch < num_channels; ch++)
+        {
+            this->setupInput(ch, typeid(gr_complex));
+            this->setupOutput(ch, typeid(gr_complex));
+        }
+
+        REGISTER_GETTER_SETTER(noise_mag)
+        REGISTER_GETTER_SETTER(iqbal_mag)
+        REGISTER_GETTER_SETTER(iqbal_phase)
+        REGISTER_GETTER_SETTER(dc_offset)
+        REGISTER_GETTER_SETTER(freq_offset)
+        REGISTER_GETTER_SETTER(beta)
+        REGISTER_GETTER_SETTER(gamma)
+        this->registerCall(this, POTHOS_FCN_TUPLE(multichannel_impairments, num_channels));
+
+        this->set_dc_offset(dc_offset);
+        this->set_freq_offset(freq_offset);
+        this->set_beta(beta);
+        this->set_gamma(gamma);
+    }
+
+    size_t num_channels() const
+    {
+        return d_num_channels;
+    }
+
+    float noise_mag() const
+    {
+        return d_noise_mag;
+    }
+
+    void set_noise_mag(float noise_mag)
+    {
+        d_noise_mag = noise_mag;
+        d_phase_noise.amplitude = dbToAmplitude(noise_mag);
+    }
+
+    std::vector<float> iqbal_mag() const
+    {
+        return d_iqbal_mag;
+    }
+
+    void set_iqbal_mag(const std::vector<float> &iqbal_mag)
+    {
+        d_iqbal_mag = perChannel("iqbal_mag", iqbal_mag, d_num_channels);
+        this->updateStages();
+    }
+
+    std::vector<float> iqbal_phase() const
+    {
+        return d_iqbal_phase;
+    }
+
+    void set_iqbal_phase(const std::vector<float> &iqbal_phase)
+    {
+        d_iqbal_phase = perChannel("iqbal_phase", iqbal_phase, d_num_channels);
+        this->updateStages();
+    }
+
+    std::vector<gr_complex> dc_offset() const
+    {
+        return d_dc_offset;
+    }
+
+    void set_dc_offset(const std::vector<gr_complex> &dc_offset)
+    {
+        d_dc_offset = perChannel("dc_offset", dc_offset, d_num_channels);
+        this->updateStages();
+    }
+
+    float freq_offset() const
+    {
+        return d_freq_offset;
+    }
+
+    void set_freq_offset(float freq_offset)
+    {
+        d_freq_offset = freq_offset;
+        d_lo.setFrequency(freq_offset);
+    }
+
+    gr_complex beta() const
+    {
+        return d_beta;
+    }
+
+    void set_beta(const gr_complex& beta)
+    {
+        d_beta = beta;
+        this->updateStages();
+    }
+
+    gr_complex gamma() const
+    {
+        return d_gamma;
+    }
+
+    void set_gamma(const gr_complex& gamma)
+    {
+        d_gamma = gamma;
+        this->updateStages();
+    }
+
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        const bool mixing = not d_lo.isIdentity();
+        for (size_t i = 0; i < num; i += IMPAIRMENT_CHUNK_SIZE)
+        {
+            const size_t n = std::min(num-i, IMPAIRMENT_CHUNK_SIZE);
+
+            //shared by all channels: down = rotation*conj(lo), up = lo
+            d_phase_noise.rotations(d_rotations.data(), n);
+            if (mixing)
+            {
+                d_lo.mixUp(d_ones.data(), d_up.data(), n);
+                volk_32fc_x2_multiply_conjugate_32fc(d_down.data(), d_rotations.data(), d_up.data(), n);
+            }
+            const gr_complex *down = mixing? d_down.data() : d_rotations.data();
+
+            for (size_t ch = 0; ch < d_num_channels; ch++)
+            {
+                const gr_complex *x = this->input(ch)->buffer().as<const gr_complex *>()+i;
+                gr_complex *y = this->output(ch)->buffer().as<gr_complex *>()+i;
+                d_stages[ch].apply(x, down, y, n);
+                if (mixing) volk_32fc_x2_multiply_32fc(y, y, d_up.data(), n);
+            }
+        }
+
+        for (size_t ch = 0; ch < d_num_channels; ch++)
+        {
+            this->input(ch)->consume(num);
+            this->output(ch)->produce(num);
+        }
+    }
+
+    //labels stay on their own channel
+    void propagateLabels(const Pothos::InputPort *input)
+    {
+        auto output = this->output(input->index());
+        for (const auto &label : input->labels())
+        {
+            output->postLabel(label);
+        }
+    }
+
+private:
+    //the shared distortion and the per channel IQ imbalance and DC offset
+    void updateStages(void)
+    {
+        for (size_t ch = 0; ch < d_num_channels; ch++)
+        {
+            d_stages[ch].beta = d_beta;
+            d_stages[ch].gamma = d_gamma;
+            d_stages[ch].dc = d_dc_offset[ch];
+            d_stages[ch].iqbal = IQMatrix::iqbal(false/*receiver*/, d_iqbal_mag[ch], d_iqbal_phase[ch]);
+        }
+    }
+
+    const size_t d_num_channels;
+    float d_noise_mag;
+    float d_freq_offset;
+    gr_complex d_beta;
+    gr_complex d_gamma;
+
+    //per channel
+    std::vector<float> d_iqbal_mag;
+    std::vector<float> d_iqbal_phase;
+    std::vector<gr_complex> d_dc_offset;
+    std::vector<ImpairmentStages> d_stages;
+
+    //shared by all channels
+    Oscillator d_lo;
+    PhaseNoise d_phase_noise;
+    std::vector<gr_complex> d_ones;
+    std::vector<gr_complex> d_rotations;
+    std::vector<gr_complex> d_up;
+    std::vector<gr_complex> d_down;
+};
+
+/***********************************************************************
+ * |PothosDoc Multichannel Radio Impairments Model
+ *
+ * Emulate the impairments of a coherent multichannel receiver.
+ * Each input is impaired and written to the output of the same index.
+ *
+ * The channels share a local oscillator, so the frequency offset,
+ * phase noise and distortion are common to all channels. The phase
+ * noise realization is the same on every channel, as it would be from
+ * a shared oscillator. IQ imbalance and DC offset are per channel:
+ * pass a list with one value per channel, or a single value for all.
+ *
+ * |category /GNURadio/Impairments
+ * |category /GNURadio/Channel Models
+ * |keywords rf iq imbalance phase noise distortion array mimo
+ *
+ * |param num_channels[Num Channels] The number of input and output ports.
+ * |widget SpinBox(minimum=1)
+ * |default 2
+ * |preview enable
+ *
+ * |param noise_mag[Phase Noise Magnitude]
+ * |widget DoubleSpinBox(minimum=-100,maximum=0,step=1)
+ * |default 0
+ * |preview enable
+ *
+ * |param iqbal_mag[IQ Magnitude Imbalance] Per-channel list or a single value.
+ * |widget LineEdit()
+ * |default [0.0]
+ * |preview enable
+ *
+ * |param iqbal_phase[IQ Phase Imbalance] Per-channel list or a single value.
+ * |widget LineEdit()
+ * |default [0.0]
+ * |preview enable
+ *
+ * |param dc_offset[DC Offset] Per-channel list of complex offsets or a single value.
+ * |widget LineEdit()
+ * |default [0.0]
+ * |preview enable
+ *
+ * |param freq_offset[Freq Offset]
+ * |widget DoubleSpinBox(minimum=-0.5,maximum=0.5,step=0.001,decimals=3)
+ * |default 0.0
+ * |preview enable
+ *
+ * |param gamma[Second Order Distortion] Second-order distortion multiplier
+ * |widget DoubleSpinBox(minimum=-0.1,maximum=0,step=0.001,decimals=3)
+ * |default 0.0
+ * |preview enable
+ *
+ * |param beta[Third Order Distortion] Third-order distortion multiplier
+ * |widget DoubleSpinBox(minimum=-0.1,maximum=0,step=0.001,decimals=3)
+ * |default 0.0
+ * |preview enable
+ *
+ * |factory /gr/channels/multichannel_impairments(num_channels,noise_mag,iqbal_mag,iqbal_phase,dc_offset,freq_offset,beta,gamma)
+ * |setter set_noise_mag(noise_mag)
+ * |setter set_iqbal_mag(iqbal_mag)
+ * |setter set_iqbal_phase(iqbal_phase)
+ * |setter set_dc_offset(dc_offset)
+ * |setter set_freq_offset(freq_offset)
+ * |setter set_beta(beta)
+ * |setter set_gamma(gamma)
+ **********************************************************************/
+static Pothos::BlockRegistry registerMultichannelImpairments(
+    "/gr/channels/multichannel_impairments",
+    Pothos::Callable(&multichannel_impairments::make));
+
+/***********************************************************************
+ * Known answers from the impairments.py stages in double precision,
+ * with the shared oscillator and per channel IQ imbalance and DC offset.
+ * The phase noise is -200 dB, so the rotation is complex(0, 1).
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_multichannel_impairments_known_answers)
+{
+    const std::vector<gr_complex> input0{
+        gr_complex(0.5f, 0.25f), gr_complex(-0.3f, 0.1f),
+        gr_complex(0.0f, -0.6f), gr_complex(0.8f, 0.0f)};
+    std::vector<gr_complex> input1;
+    for (const auto &x : input0) input1.push_back(std::conj(x));
+
+    auto impairments = Pothos::BlockRegistry::make("/gr/channels/multichannel_impairments",
+        size_t(2), -200.0f,
+        std::vector<float>{1.0f, -0.5f},
+        std::vector<float>{5.0f, 10.0f},
+        std::vector<gr_complex>{gr_complex(0.01f, -0.02f), gr_complex(-0.03f, 0.0f)},
+        0.25f, gr_complex(-0.05f, 0.02f), gr_complex(-0.03f, 0.01f));
+    const auto outputs = runChannelBlock<gr_complex, gr_complex>(impairments, {input0, input1}, 2);
+
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(-0.2211787f, 0.4792036f),
+        gr_complex(-0.0824569f, -0.3191755f),
+        gr_complex(0.6716750f, 0.0175296f),
+        gr_complex(-0.0187219f, 0.8958555f)},
+        outputs[0], 1e-5f);
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.2703250f, 0.4877327f),
+        gr_complex(0.1001119f, -0.3292658f),
+        gr_complex(-0.5001987f, -0.0111104f),
+        gr_complex(0.0012781f, 0.7833648f)},
+        outputs[1], 1e-5f);
+}
+
+/***********************************************************************
+ * Labels only come out of the output for their own channel
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_multichannel_impairments_labels)
+{
+    const size_t numChannels = 2;
+    const size_t numElements = 16;
+
+    auto impairments = Pothos::BlockRegistry::make("/gr/channels/multichannel_impairments",
+        numChannels, -200.0f,
+        std::vector<float>{0.0f}, std::vector<float>{0.0f}, std::vector<gr_complex>{gr_complex(0.0f)},
+        0.0f, gr_complex(0.0f), gr_complex(0.0f));
+
+    Pothos::Topology topology;
+    std::vector<Pothos::Proxy> collectors;
+    for (size_t ch = 0; ch < numChannels; ch++)
+    {
+        auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+        feeder.call("feedLabels", std::vector<Pothos::Label>{Pothos::Label("ch"+std::to_string(ch), ch, ch+1)});
+        Pothos::BufferChunk buff(Pothos::DType("complex_float32"), numElements);
+        std::fill(buff.as<gr_complex *>(), buff.as<gr_complex *>()+numElements, gr_complex(1.0f));
+        feeder.call("feedBuffer", buff);
+        topology.connect(feeder, 0, impairments, std::to_string(ch));
+
+        collectors.push_back(Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32"));
+        topology.connect(impairments, std::to_string(ch), collectors.back(), 0);
+    }
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive());
+
+    for (size_t ch = 0; ch < numChannels; ch++)
+    {
+        const auto labels = collectors[ch].call<std::vector<Pothos::Label>>("getLabels");
+        POTHOS_TEST_EQUAL(1, labels.size());
+        POTHOS_TEST_EQUAL("ch"+std::to_string(ch), labels[0].id);
+        POTHOS_TEST_EQUAL(ch+1, labels[0].index);
+    }
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "impairment_kernels.h"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Object.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A Gaussian noise source on the counter-based generator used for the
+ * phase noise of the channel blocks. Unlike gr::analog::noise_source,
+ * the output of a (seed, stream) pair can be generated from any offset,
+ * so a long run can be split across threads or hosts and reassembled
+ * sample for sample. Complex samples use two consecutive noise values.
+ */
+
+class noise_source: public Pothos::Block
+{
+public:
+    static Pothos::Block* make(const Pothos::DType &dtype, float amplitude, unsigned long long seed, unsigned long long stream_id)
+    {
+        return new noise_source(dtype, amplitude, seed, stream_id);
+    }
+
+    noise_source(const Pothos::DType &dtype, float amplitude, unsigned long long seed, unsigned long long stream_id):
+        Pothos::Block(),
+        d_amplitude(amplitude),
+        d_complex(dtype.isComplex()),
+        d_floats_per_element(dtype.size()/sizeof(float)),
+        d_noise(seed, stream_id)
+    {
+        if (not dtype.isFloat() or dtype.elemSize() != (d_complex? 2 : 1)*sizeof(float))
+        {
+            throw Pothos::InvalidArgumentException("noise_source: unsupported dtype", dtype.name());
+        }
+
+        this->setupOutput(0, dtype);
+
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, amplitude));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, set_amplitude));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, seed));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, set_seed));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, stream_id));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, set_stream_id));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, position));
+        this->registerCall(this, POTHOS_FCN_TUPLE(noise_source, seek));
+        this->registerProbe("amplitude", "amplitude_triggered", "probe_amplitude");
+        this->registerProbe("position", "position_triggered", "probe_position");
+    }
+
+    float amplitude() const
+    {
+        return d_amplitude;
+    }
+
+    void set_amplitude(float amplitude)
+    {
+        d_amplitude = amplitude;
+    }
+
+    unsigned long long seed() const
+    {
+        return d_noise.seed;
+    }
+
+    void set_seed(unsigned long long seed)
+    {
+        d_noise.seed = seed;
+    }
+
+    unsigned long long stream_id() const
+    {
+        return d_noise.stream;
+    }
+
+    void set_stream_id(unsigned long long stream_id)
+    {
+        d_noise.stream = stream_id;
+    }
+
+    //! The sample offset of the next output
+    unsigned long long position() const
+    {
+        return d_noise.position/d_floats_per_element;
+    }
+
+    void seek(unsigned long long offset)
+    {
+        d_noise.seek(offset*d_floats_per_element);
+    }
+
+    void work(void)
+    {
+        auto outPort = this->output(0);
+        const size_t num = outPort->elements();
+        if (num == 0) return;
+
+        //the complex components each carry half of the power
+        const size_t numFloats = num*d_floats_per_element;
+        const float scale = d_complex? d_amplitude*float(M_SQRT1_2) : d_amplitude;
+        float *out = outPort->buffer().as<float *>();
+        d_noise.fill(out, numFloats);
+        for (size_t i = 0; i < numFloats; i++) out[i] *= scale;
+
+        outPort->produce(num);
+    }
+
+private:
+    float d_amplitude;
+    const bool d_complex;
+    const size_t d_floats_per_element;
+    GaussianNoise d_noise;
+};
+
+/***********************************************************************
+ * |PothosDoc Counter-Based Noise Source
+ *
+ * Generates Gaussian noise that is reproducible from any sample offset.
+ *
+ * The noise for a seed and stream ID is fixed, and seek() moves the
+ * output to any sample of it. Blocks with different stream IDs produce
+ * independent noise, so parallel runs can each take a stream, or each
+ * seek to their own section of one stream.
+ *
+ * |category /GNURadio/Channel Models
+ * |category /GNURadio/Waveform Generators
+ * |keywords rf noise gaussian random philox
+ *
+ * |param dtype[Data Type] The output sample type.
+ * |widget DTypeChooser(float32=1,cfloat32=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param amplitude[Amplitude] The standard deviation of the noise.
+ * |widget DoubleSpinBox(minimum=0)
+ * |default 1.0
+ * |preview enable
+ *
+ * |param seed[Seed]
+ * |widget SpinBox(minimum=0)
+ * |default 42
+ * |preview enable
+ *
+ * |param stream_id[Stream ID]
+ * |widget SpinBox(minimum=0)
+ * |default 0
+ * |preview enable
+ *
+ * |factory /gr/channels/noise_source(dtype, amplitude, seed, stream_id)
+ * |setter set_amplitude(amplitude)
+ * |setter set_seed(seed)
+ * |setter set_stream_id(stream_id)
+ **********************************************************************/
+static Pothos::BlockRegistry registerNoiseSource(
+    "/gr/channels/noise_source",
+    Pothos::Callable(&noise_source::make));
+
+/***********************************************************************
+ * Tests
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_philox_known_answers)
+{
+    //known answer vectors from the Random123 distribution (kat_vectors)
+    uint32_t zeros[4] = {0, 0, 0, 0};
+    philox4x32(zeros, 0, 0);
+    POTHOS_TEST_EQUAL(zeros[0], 0x6627e8d5u);
+    POTHOS_TEST_EQUAL(zeros[1], 0xe169c58du);
+    POTHOS_TEST_EQUAL(zeros[2], 0xbc57ac4cu);
+    POTHOS_TEST_EQUAL(zeros[3], 0x9b00dbd8u);
+
+    uint32_t ones[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+    philox4x32(ones, 0xffffffff, 0xffffffff);
+    POTHOS_TEST_EQUAL(ones[0], 0x408f276du);
+    POTHOS_TEST_EQUAL(ones[1], 0x41c83b0eu);
+    POTHOS_TEST_EQUAL(ones[2], 0xa20bc7c6u);
+    POTHOS_TEST_EQUAL(ones[3], 0x6d5451fdu);
+
+    uint32_t pi[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    philox4x32(pi, 0xa4093822, 0x299f31d0);
+    POTHOS_TEST_EQUAL(pi[0], 0xd16cfe09u);
+    POTHOS_TEST_EQUAL(pi[1], 0x94fdccebu);
+    POTHOS_TEST_EQUAL(pi[2], 0x5001e420u);
+    POTHOS_TEST_EQUAL(pi[3], 0x24126ea1u);
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_noise_seek_split)
+{
+    const size_t num = 10000;
+    GaussianNoise sequential(42, 7);
+    std::vector<float> expected(num);
+    sequential.fill(expected.data(), num);
+
+    //split at offsets that are not multiples of the four sample blocks,
+    //each part generated by its own generator as a worker would
+    const std::vector<size_t> splits = {0, 1, 3, 517, 2049, 6003, num};
+    std::vector<float> actual(num);
+    for (size_t i = 0; i+1 < splits.size(); i++)
+    {
+        GaussianNoise worker(42, 7);
+        worker.seek(splits[i]);
+        worker.fill(actual.data()+splits[i], splits[i+1]-splits[i]);
+        POTHOS_TEST_EQUAL(worker.position, splits[i+1]);
+    }
+    POTHOS_TEST_EQUALV(expected, actual);
+
+    //the block reports and seeks in samples, complex samples use two values
+    auto source = Pothos::BlockRegistry::make("/gr/channels/noise_source", "complex_float32", 1.0f, 42ull, 7ull);
+    source.call("seek", 100ull);
+    POTHOS_TEST_EQUAL(source.call<unsigned long long>("position"), 100ull);
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_noise_streams)
+{
+    const size_t num = 100000;
+    GaussianNoise stream0(42, 0), stream1(42, 1), seed43(43, 0);
+    std::vector<float> x0(num), x1(num), x2(num);
+    stream0.fill(x0.data(), num);
+    stream1.fill(x1.data(), num);
+    seed43.fill(x2.data(), num);
+
+    //unit variance, and uncorrelated across streams and seeds:
+    //the correlation of independent streams has a deviation of 1/sqrt(num)
+    double power = 0.0, corrStreams = 0.0, corrSeeds = 0.0;
+    for (size_t i = 0; i < num; i++)
+    {
+        power += x0[i]*x0[i];
+        corrStreams += x0[i]*x1[i];
+        corrSeeds += x0[i]*x2[i];
+    }
+    POTHOS_TEST_CLOSE(power/num, 1.0, 0.02);
+    POTHOS_TEST_TRUE(std::abs(corrStreams/num) < 0.02);
+    POTHOS_TEST_TRUE(std::abs(corrSeeds/num) < 0.02);
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Object.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
+
+#include <gnuradio/types.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Generalizes the gr-channels distortion_2_gen and distortion_3_gen
+ * hierarchical blocks to a polynomial gain of any order, evaluated in
+ * one pass over each chunk of samples.
+ */
+
+static Polynomial::Drive toDrive(const std::string &drive)
+{
+    if (drive == "ENVELOPE") return Polynomial::ENVELOPE;
+    if (drive == "IN_PHASE") return Polynomial::IN_PHASE;
+    throw Pothos::InvalidArgumentException("nonlinearity: unknown drive", drive);
+}
+
+class nonlinearity: public Pothos::Block
+{
+public:
+    static Pothos::Block* make(const std::vector<gr_complex> &coefficients, const std::string &drive)
+    {
+        return new nonlinearity(coefficients, drive);
+    }
+
+    nonlinearity(const std::vector<gr_complex> &coefficients, const std::string &drive):
+        Pothos::Block(),
+        d_coefficients(coefficients),
+        d_drive(drive),
+        d_polynomial(coefficients, toDrive(drive))
+    {
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
+
+        this->registerCall(this, POTHOS_FCN_TUPLE(nonlinearity, coefficients));
+        this->registerCall(this, POTHOS_FCN_TUPLE(nonlinearity, set_coefficients));
+        this->registerCall(this, POTHOS_FCN_TUPLE(nonlinearity, drive));
+        this->registerCall(this, POTHOS_FCN_TUPLE(nonlinearity, set_drive));
+        this->registerProbe("coefficients", "coefficients_triggered", "probe_coefficients");
+        this->registerProbe("drive", "drive_triggered", "probe_drive");
+    }
+
+    std::vector<gr_complex> coefficients() const
+    {
+        return d_coefficients;
+    }
+
+    void set_coefficients(const std::vector<gr_complex> &coefficients)
+    {
+        d_polynomial.setCoefficients(coefficients, toDrive(d_drive));
+        d_coefficients = coefficients;
+    }
+
+    std::string drive() const
+    {
+        return d_drive;
+    }
+
+    void set_drive(const std::string &drive)
+    {
+        d_polynomial.setCoefficients(d_coefficients, toDrive(drive));
+        d_drive = drive;
+    }
+
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        d_polynomial.apply(inPort->buffer().as<const gr_complex *>(), outPort->buffer().as<gr_complex *>(), num);
+
+        inPort->consume(num);
+        outPort->produce(num);
+    }
+
+private:
+    std::vector<gr_complex> d_coefficients;
+    std::string d_drive;
+    Polynomial d_polynomial;
+};
+
+/***********************************************************************
+ * |PothosDoc Nonlinearity
+ *
+ * Applies a memoryless polynomial gain to the input signal.
+ *
+ * y = x * (c[0] + c[1]*u + c[2]*u^2 + ...)
+ *
+ * With the envelope drive u = |x|, the magnitude of the gain is the
+ * AM-AM response and its angle is the AM-PM response.
+ * The in-phase drive u = 2*Re(x) gives the second-order distortion
+ * of distortion_2_gen.
+ *
+ * |category /GNURadio/Impairments
+ * |keywords rf distortion polynomial amam ampm
+ *
+ * |param coefficients[Coefficients] Polynomial coefficients, lowest order first.
+ * |widget LineEdit()
+ * |default [1.0, 0.0, 0.1]
+ * |preview enable
+ *
+ * |param drive[Drive] The term the polynomial is evaluated in.
+ * |widget ComboBox(editable=false)
+ * |option [Envelope] "ENVELOPE"
+ * |option [In-Phase] "IN_PHASE"
+ * |default "ENVELOPE"
+ * |preview enable
+ *
+ * |factory /gr/channels/nonlinearity(coefficients, drive)
+ * |setter set_coefficients(coefficients)
+ * |setter set_drive(drive)
+ **********************************************************************/
+static Pothos::BlockRegistry registerNonlinearity(
+    "/gr/channels/nonlinearity",
+    Pothos::Callable(&nonlinearity::make));
+
+/***********************************************************************
+ * Known answers from y = x*sum(c[k]*u^k) in double precision
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_nonlinearity_known_answers)
+{
+    const std::vector<gr_complex> input{
+        gr_complex(0.5f, 0.25f), gr_complex(-0.3f, 0.1f),
+        gr_complex(0.0f, -0.6f), gr_complex(0.8f, 0.0f)};
+    const std::vector<gr_complex> oddAndEven{
+        gr_complex(1.0f, 0.0f), gr_complex(-0.1f, 0.05f),
+        gr_complex(0.2f, -0.1f), gr_complex(0.0f, -0.05f)};
+
+    //odd and even orders, evaluated in |x|
+    auto envelope = Pothos::BlockRegistry::make("/gr/channels/nonlinearity", oddAndEven, "ENVELOPE");
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.5063076f, 0.2456327f),
+        gr_complex(-0.2969362f, 0.0975686f),
+        gr_complex(-0.0100800f, -0.6072000f),
+        gr_complex(0.8384000f, -0.0396800f)},
+        runChannelBlock<gr_complex>(envelope, input), 1e-6f);
+
+    //even orders only, evaluated in |x|^2
+    auto evenOnly = Pothos::BlockRegistry::make("/gr/channels/nonlinearity",
+        std::vector<gr_complex>{gr_complex(1.0f), gr_complex(0.0f), gr_complex(-0.2f, 0.1f)}, "ENVELOPE");
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.4609375f, 0.2500000f),
+        gr_complex(-0.2950000f, 0.0950000f),
+        gr_complex(0.0216000f, -0.5568000f),
+        gr_complex(0.6976000f, 0.0512000f)},
+        runChannelBlock<gr_complex>(evenOnly, input), 1e-6f);
+
+    //the drive update keeps the coefficients, evaluated in 2*Re(x)
+    auto inPhase = Pothos::BlockRegistry::make("/gr/channels/nonlinearity", oddAndEven, "ENVELOPE");
+    inPhase.call("set_drive", "IN_PHASE");
+    POTHOS_TEST_EQUAL("IN_PHASE", inPhase.call<std::string>("drive"));
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.5750000f, 0.2250000f),
+        gr_complex(-0.3340800f, 0.1297600f),
+        gr_complex(0.0000000f, -0.6000000f),
+        gr_complex(1.0816000f, -0.3046400f)},
+        runChannelBlock<gr_complex>(inPhase, input), 1e-6f);
+}
@@ -19,108 +19,74 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
 
-#include <gnuradio/gr_complex.h>
+#include <gnuradio/types.h>
 
 /*
  * Ported from: gr-channels/python/phase_bal.py
  */
 
-static constexpr size_t vlen = 1;
-
-class phase_bal: public Pothos::Topology
+class phase_bal: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(double alpha)
+    static Pothos::Block* make(double alpha)
     {
         return new phase_bal(alpha);
     }
 
     phase_bal(double alpha):
-        Pothos::Topology(),
-        d_add_const_cc0(Pothos::BlockRegistry::make("/gr/blocks/add_const", "add_const_cc", gr_complex(0.0,0.0))),
-        d_single_pole_iir_filter_ff0(Pothos::BlockRegistry::make("/gr/filter/single_pole_iir_filter", "single_pole_iir_filter_ff", alpha, vlen)),
-        d_sub_ff0(Pothos::BlockRegistry::make("/gr/blocks/sub", "sub_ff", vlen)),
-        d_sub_ff1(Pothos::BlockRegistry::make("/gr/blocks/sub", "sub_ff", vlen)),
-        d_multiply_ff0(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_ff", vlen)),
-        d_multiply_ff1(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_ff", vlen)),
-        d_multiply_ff2(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_ff", vlen)),
-        d_multiply_const_vff0(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_vff", std::vector<float>{2.0f}, vlen)),
-        d_float_to_complex0(Pothos::BlockRegistry::make("/gr/blocks/float_to_complex", vlen)),
-        d_divide_ff0(Pothos::BlockRegistry::make("/gr/blocks/divide", "divide_ff", vlen)),
-        d_complex_to_mag_squared0(Pothos::BlockRegistry::make("/gr/blocks/complex_to_mag_squared", vlen)),
-        d_complex_to_float0(Pothos::BlockRegistry::make("/gr/blocks/complex_to_float", vlen))
+        Pothos::Block(),
+        d_balance(alpha)
     {
-        // Note: this add_const_cc wasn't in the original block, but without it,
-        // PothosFlow evaluates this topology's input type as int16[4].
-        this->connect(this, 0, d_add_const_cc0, 0);
-        this->connect(d_add_const_cc0, 0, d_complex_to_float0, 0);
-        this->connect(d_add_const_cc0, 0, d_complex_to_mag_squared0, 0);
-        this->connect(d_float_to_complex0, 0, this, 0);
-
-        this->connect(d_complex_to_float0, 0, d_multiply_ff0, 0);
-        this->connect(d_complex_to_float0, 1, d_multiply_ff0, 1);
-        this->connect(d_multiply_ff0, 0, d_divide_ff0, 0);
-        this->connect(d_sub_ff0, 0, d_float_to_complex0, 1);
-        this->connect(d_multiply_ff1, 0, d_sub_ff0, 1);
-        this->connect(d_single_pole_iir_filter_ff0, 0, d_multiply_ff1, 1);
-        this->connect(d_complex_to_float0, 0, d_multiply_ff1, 0);
-        this->connect(d_multiply_ff2, 0, d_sub_ff1, 1);
-        this->connect(d_complex_to_float0, 1, d_sub_ff0, 0);
-        this->connect(d_sub_ff1, 0, d_float_to_complex0, 0);
-        this->connect(d_complex_to_mag_squared0, 0, d_divide_ff0, 1);
-        this->connect(d_complex_to_float0, 0, d_sub_ff1, 0);
-        this->connect(d_divide_ff0, 0, d_multiply_const_vff0, 0);
-        this->connect(d_multiply_const_vff0, 0, d_single_pole_iir_filter_ff0, 0);
-        this->connect(d_single_pole_iir_filter_ff0, 0, d_multiply_ff2, 0);
-        this->connect(d_complex_to_float0, 1, d_multiply_ff2, 1);
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
 
         this->registerCall(this, POTHOS_FCN_TUPLE(phase_bal, alpha));
         this->registerCall(this, POTHOS_FCN_TUPLE(phase_bal, set_alpha));
+        this->registerCall(this, POTHOS_FCN_TUPLE(phase_bal, estimate));
+        this->registerProbe("alpha", "alpha_triggered", "probe_alpha");
+        this->registerProbe("estimate", "estimate_triggered", "probe_estimate");
     }
 
     double alpha() const
     {
-        return d_alpha;
+        return d_balance.alpha;
     }
 
     void set_alpha(double alpha)
     {
-        d_alpha = alpha;
+        d_balance.alpha = alpha;
+    }
+
+    //! The current running average of 2*I*Q/|x|^2
+    double estimate() const
+    {
+        return d_balance.estimate;
     }
 
-    Pothos::Object opaqueCallMethod(const std::string &name, const Pothos::Object *inputArgs, const size_t numArgs) const
+    void work(void)
     {
-        // Try the topology first, then the other block with relevant calls.
-        try
-        {
-            return Pothos::Topology::opaqueCallMethod(name, inputArgs, numArgs);
-        }
-        catch (const Pothos::BlockCallNotFound&){}
-
-        return d_single_pole_iir_filter_ff0.call<Pothos::Block*>("getPointer")->opaqueCallMethod(name, inputArgs, numArgs);
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        d_balance.apply(inPort->buffer().as<const gr_complex *>(), outPort->buffer().as<gr_complex *>(), num);
+
+        inPort->consume(num);
+        outPort->produce(num);
     }
 
 private:
-    double d_alpha;
-
-    Pothos::Proxy d_add_const_cc0;
-
-    Pothos::Proxy d_single_pole_iir_filter_ff0;
-    Pothos::Proxy d_sub_ff0;
-    Pothos::Proxy d_sub_ff1;
-    Pothos::Proxy d_multiply_ff0;
-    Pothos::Proxy d_multiply_ff1;
-    Pothos::Proxy d_multiply_ff2;
-    Pothos::Proxy d_multiply_const_vff0;
-    Pothos::Proxy d_float_to_complex0;
-    Pothos::Proxy d_divide_ff0;
-    Pothos::Proxy d_complex_to_mag_squared0;
-    Pothos::Proxy d_complex_to_float0;
+    PhaseBalance d_balance;
 };
 
 /***********************************************************************
@@ -128,6 +94,10 @@ private:
  *
  * Restores IQ phase balance.
  *
+ * The running average of the normalized IQ correlation is tracked
+ * sample by sample and subtracted from each component.
+ * The current estimate can be read with the estimate probe.
+ *
  * |category /GNURadio/Impairments
  * |keywords rf iq rms alpha
  *
@@ -138,8 +108,26 @@ private:
  * |preview enable
  *
  * |factory /gr/channels/phase_bal(alpha)
- * |initializer set_alpha(alpha)
+ * |setter set_alpha(alpha)
  **********************************************************************/
 static Pothos::BlockRegistry registerPhaseBal(
     "/gr/channels/phase_bal",
     Pothos::Callable(&phase_bal::make));
+
+/***********************************************************************
+ * Known answers from the gr-channels phase_bal recurrence in double precision:
+ * the zero sample leaves the running estimate alone
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_phase_bal_known_answers)
+{
+    auto balance = Pothos::BlockRegistry::make("/gr/channels/phase_bal", 0.5);
+    testChannelClose(std::vector<gr_complex>{
+        gr_complex(0.8000000f, 0.1000000f),
+        gr_complex(0.7200000f, -0.2400000f),
+        gr_complex(0.0000000f, 0.0000000f),
+        gr_complex(-0.4500000f, 0.0000000f),
+        gr_complex(0.3439189f, 0.5885135f)},
+        runChannelBlock<gr_complex>(balance, std::vector<gr_complex>{
+            gr_complex(1.0f, 0.5f), gr_complex(0.8f, -0.4f), gr_complex(0.0f, 0.0f),
+            gr_complex(-0.6f, 0.3f), gr_complex(0.5f, 0.7f)}), 1e-6f);
+}
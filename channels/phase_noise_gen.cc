@@ -19,93 +19,141 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
+#include <Pothos/Testing.hpp>
+
+#include <Poco/Logger.h>
 
 #include <gnuradio/types.h>
 
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
 /*
  * Ported from: gr-channels/python/phase_noise_gen.py
+ *
+ * The hierarchical block filters a noise source with a single pole IIR,
+ * takes sin and cos of it with transcendental blocks and multiplies the
+ * input by the result. Here the noise is generated and filtered for a
+ * chunk at a time, followed by a polynomial sincos and VOLK multiply.
+ * The noise is counter-based, so it can be seeked and split into
+ * independent streams.
  */
 
-static constexpr size_t vlen = 1;
+static constexpr uint64_t noiseSeed = 42;
 
-class phase_noise_gen: public Pothos::Topology
+class phase_noise_gen: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(float noise_mag, float alpha)
+    static Pothos::Block* make(float noise_mag, float alpha)
     {
         return new phase_noise_gen(noise_mag, alpha);
     }
-    
+
     phase_noise_gen(float noise_mag, float alpha):
-        Pothos::Topology(),
-        d_single_pole_iir_filter_ff0(Pothos::BlockRegistry::make("/gr/filter/single_pole_iir_filter", "single_pole_iir_filter_ff", alpha, vlen)),
-        d_transcendental0(Pothos::BlockRegistry::make("/gr/blocks/transcendental", "sin", "float")),
-        d_transcendental1(Pothos::BlockRegistry::make("/gr/blocks/transcendental", "cos", "float")),
-        d_multiply_cc0(Pothos::BlockRegistry::make("/gr/blocks/multiply", "multiply_cc", vlen)),
-        d_float_to_complex0(Pothos::BlockRegistry::make("/gr/blocks/float_to_complex", vlen)),
-        d_noise_source_f0(Pothos::BlockRegistry::make("/gr/analog/noise_source", "noise_source_f", "GR_GAUSSIAN", noise_mag, 42)),
-        d_alpha_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(float))))
+        Pothos::Block(),
+        d_phase_noise(noise_mag, alpha, noiseSeed),
+        d_rotations(IMPAIRMENT_CHUNK_SIZE)
     {
-        d_alpha_constant_source.call("setConstant", alpha);
-        
-        // Assemble flowgraph
-        this->connect(d_float_to_complex0, 0, d_multiply_cc0, 1);
-        this->connect(d_noise_source_f0, 0, d_single_pole_iir_filter_ff0, 0);
-        this->connect(this, 0, d_multiply_cc0, 0);
-        this->connect(d_multiply_cc0, 0, this, 0);
-        this->connect(d_single_pole_iir_filter_ff0, 0, d_transcendental0, 0);
-        this->connect(d_single_pole_iir_filter_ff0, 0, d_transcendental1, 0);
-        this->connect(d_transcendental0, 0, d_float_to_complex0, 0);
-        this->connect(d_transcendental1, 0, d_float_to_complex0, 1);
-
-        // Add calls or connect to internal calls
+        this->setupInput(0, typeid(gr_complex));
+        this->setupOutput(0, typeid(gr_complex));
+
         this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, noise_mag));
         this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, set_noise_mag));
-        this->connect(this, "set_noise_mag", d_noise_source_f0, "set_amplitude");
         this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, alpha));
         this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, set_alpha));
-        this->connect(this, "set_alpha", d_single_pole_iir_filter_ff0, "set_taps");
-        this->connect(this, "set_alpha", d_alpha_constant_source, "setConstant");
-
-        // Expose internal probes
-        this->connect(this, "probe_alpha", d_alpha_constant_source, "probeConstant");
-        this->connect(d_alpha_constant_source, "constantTriggered", this, "alpha_triggered");
-        this->connect(this, "probe_noise_mag", d_noise_source_f0, "probe_amplitude");
-        this->connect(d_noise_source_f0, "amplitude_triggered", this, "noise_mag_triggered");
+        this->registerProbe("noise_mag", "noise_mag_triggered", "probe_noise_mag");
+        this->registerProbe("alpha", "alpha_triggered", "probe_alpha");
+        this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, stream_id));
+        this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, set_stream_id));
+        this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, position));
+        this->registerCall(this, POTHOS_FCN_TUPLE(phase_noise_gen, seek));
+
+        this->set_alpha(alpha);
     }
 
     float noise_mag() const
     {
-        return d_noise_source_f0.call("amplitude");
+        return d_phase_noise.amplitude;
     }
 
-    // Put this here so we can connect to the internal block.
-    void set_noise_mag(float) {}
+    void set_noise_mag(float noise_mag)
+    {
+        d_phase_noise.amplitude = noise_mag;
+    }
 
     float alpha() const
     {
-        return d_alpha_constant_source.call("constant");
+        return d_phase_noise.alpha;
+    }
+
+    //the filter is stable for |1-alpha| < 1, alpha 0 holds the phase at 0,
+    //other values are clamped so saved topologies from gr-channels still load
+    void set_alpha(float alpha)
+    {
+        static const float maxAlpha = std::nextafter(2.0f, 0.0f);
+        const float clamped = (alpha >= 0.0f)? std::min(alpha, maxAlpha) : 0.0f;
+        if (clamped != alpha)
+        {
+            Poco::Logger::get("phase_noise_gen").warning("alpha %s is outside of [0, 2), using %s",
+                std::to_string(alpha), std::to_string(clamped));
+        }
+        d_phase_noise.alpha = clamped;
     }
 
-    // Put this here so we can connect to the internal blocks.
-    void set_alpha(float) {}
+    //! The noise stream, instances with different IDs are independent
+    unsigned long long stream_id() const
+    {
+        return d_phase_noise.noise.stream;
+    }
+
+    void set_stream_id(unsigned long long stream_id)
+    {
+        d_phase_noise.noise.stream = stream_id;
+    }
+
+    //! The sample offset of the next output in the noise stream
+    unsigned long long position() const
+    {
+        return d_phase_noise.noise.position;
+    }
+
+    void seek(unsigned long long offset)
+    {
+        d_phase_noise.seek(offset);
+    }
+
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
+
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        const auto in = inPort->buffer().as<const gr_complex *>();
+        const auto out = outPort->buffer().as<gr_complex *>();
+
+        for (size_t i = 0; i < num; i += IMPAIRMENT_CHUNK_SIZE)
+        {
+            const size_t n = std::min(num-i, IMPAIRMENT_CHUNK_SIZE);
+            d_phase_noise.rotations(d_rotations.data(), n);
+            volk_32fc_x2_multiply_32fc(out+i, in+i, d_rotations.data(), n);
+        }
+
+        inPort->consume(num);
+        outPort->produce(num);
+    }
 
 private:
-    Pothos::Proxy d_single_pole_iir_filter_ff0;
-    Pothos::Proxy d_transcendental0;
-    Pothos::Proxy d_transcendental1;
-    Pothos::Proxy d_multiply_cc0;
-    Pothos::Proxy d_float_to_complex0;
-    Pothos::Proxy d_noise_source_f0;
-
-    // We need to use this block to store alpha since we can't query
-    // it from the block that uses it. This lets us emulate a probe
-    // in a topology.
-    Pothos::Proxy d_alpha_constant_source;
+    PhaseNoise d_phase_noise;
+    std::vector<gr_complex> d_rotations;
 };
 
 /***********************************************************************
@@ -121,15 +169,85 @@ private:
  * |default 0.0
  * |preview enable
  *
- * |param alpha[Alpha]
- * |widget DoubleSpinBox(minimum=-50,maximum=50)
+ * |param alpha[Alpha] The gain of the single pole filter, in [0, 2).
+ * Values outside of the range are clamped to it with a warning.
+ * |widget DoubleSpinBox(minimum=0,maximum=1.999,step=0.01,decimals=3)
  * |default 0.1
  * |preview enable
  *
+ * |param stream_id[Noise Stream] The counter-based noise stream.
+ * Blocks with different streams produce independent phase noise.
+ * seek() resumes the stream at any offset, with the filter state
+ * matching a continuous run to within float precision.
+ * |widget SpinBox(minimum=0)
+ * |default 0
+ * |preview valid
+ *
  * |factory /gr/channels/phase_noise_gen(noise_mag,alpha)
  * |setter set_noise_mag(noise_mag)
  * |setter set_alpha(alpha)
+ * |setter set_stream_id(stream_id)
  **********************************************************************/
 static Pothos::BlockRegistry registerPhaseNoiseGen(
     "/gr/channels/phase_noise_gen",
     Pothos::Callable(&phase_noise_gen::make));
+
+/***********************************************************************
+ * Tests
+ **********************************************************************/
+static std::vector<gr_complex> phaseNoiseRun(PhaseNoise &phaseNoise, const size_t num)
+{
+    std::vector<gr_complex> rot(num);
+    for (size_t i = 0; i < num; i += IMPAIRMENT_CHUNK_SIZE)
+    {
+        phaseNoise.rotations(rot.data()+i, std::min(num-i, IMPAIRMENT_CHUNK_SIZE));
+    }
+    return rot;
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_phase_noise_seek)
+{
+    const size_t offset = 10007;
+    const size_t num = 2000;
+    for (const float alpha : {0.0f, 0.01f, 0.5f, 1.0f, 1.5f})
+    {
+        PhaseNoise sequential(1.0f, alpha, noiseSeed);
+        const auto expected = phaseNoiseRun(sequential, offset+num);
+
+        PhaseNoise seeked(1.0f, alpha, noiseSeed);
+        seeked.seek(offset);
+        const auto actual = phaseNoiseRun(seeked, num);
+
+        //the rebuilt filter state matches to within float precision
+        for (size_t i = 0; i < num; i++)
+        {
+            POTHOS_TEST_CLOSE(expected[offset+i].real(), actual[i].real(), 1e-5f);
+            POTHOS_TEST_CLOSE(expected[offset+i].imag(), actual[i].imag(), 1e-5f);
+        }
+    }
+
+    //the replay is capped for filters with a very long memory:
+    //the pole 1-1e-6 is below 1 and needs about 1.6e7 samples to decay
+    const float slowAlpha = 1e-6f;
+    POTHOS_TEST_TRUE(1.0f-slowAlpha < 1.0f);
+    POTHOS_TEST_TRUE(std::log(1e-7)/std::log(double(1.0f-slowAlpha)) > double(PHASE_NOISE_MAX_WARMUP));
+    PhaseNoise slow(1.0f, slowAlpha, noiseSeed);
+    slow.seek(uint64_t(1e12));
+    POTHOS_TEST_EQUAL(slow.noise.position, uint64_t(1e12));
+    POTHOS_TEST_TRUE(std::isfinite(slow.prev));
+    POTHOS_TEST_TRUE(slow.prev != 0.0f);
+}
+
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_phase_noise_alpha_range)
+{
+    auto phaseNoiseGen = Pothos::BlockRegistry::make("/gr/channels/phase_noise_gen", 0.0f, 0.1f);
+    phaseNoiseGen.call("set_alpha", 1.5f);
+    POTHOS_TEST_EQUAL(phaseNoiseGen.call<float>("alpha"), 1.5f);
+
+    //out of range values are clamped rather than rejected
+    phaseNoiseGen.call("set_alpha", 2.0f);
+    POTHOS_TEST_TRUE(phaseNoiseGen.call<float>("alpha") < 2.0f);
+    POTHOS_TEST_TRUE(phaseNoiseGen.call<float>("alpha") > 1.999f);
+    phaseNoiseGen.call("set_alpha", -0.1f);
+    POTHOS_TEST_EQUAL(phaseNoiseGen.call<float>("alpha"), 0.0f);
+}
@@ -19,93 +19,97 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "impairment_kernels.h"
+#include "impairment_testing.h"
+
 #include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
-
-#include <cmath>
+#include <Pothos/Testing.hpp>
 
 /*
  * Ported from: gr-channels/python/quantizer.py
+ *
+ * The hierarchical block scales by 2^(bits-1), converts to shorts and
+ * back, and scales by the inverse. This block computes the same result
+ * in one pass over the samples. Complex samples are quantized per
+ * component, so both types run the same kernel over floats.
  */
 
-static constexpr int vlen = 1;
-static constexpr float scale = 1.0f;
-
-static float convertBits(size_t bits)
-{
-    return std::pow(2.0f, static_cast<float>(bits)-1);
-}
-
-class quantizer: public Pothos::Topology
+class quantizer: public Pothos::Block
 {
 public:
-    static Pothos::Topology* make(size_t bits)
+    //the original float only factory
+    static Pothos::Block* make(size_t bits)
     {
-        return new quantizer(bits);
+        return new quantizer(typeid(float), bits);
     }
 
-    quantizer(size_t bits):
-        Pothos::Topology(),
-        d_short_to_float0(Pothos::BlockRegistry::make("/gr/blocks/short_to_float", vlen, scale)),
-        d_float_to_short0(Pothos::BlockRegistry::make("/gr/blocks/float_to_short", vlen, scale)),
-        d_multiply_const_ff0(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_ff", convertBits(bits), vlen)),
-        d_multiply_const_ff1(Pothos::BlockRegistry::make("/gr/blocks/multiply_const", "multiply_const_ff", 1.0f/convertBits(bits), vlen)),
-        d_triggered_signal(Pothos::BlockRegistry::make("/blocks/triggered_signal")),
-        d_bits_constant_source(Pothos::BlockRegistry::make("/blocks/constant_source", Pothos::DType(typeid(size_t)))),
-        d_bits_eval0(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"bits"})),
-        d_bits_eval1(Pothos::BlockRegistry::make("/blocks/evaluator", std::vector<std::string>{"bits"}))
+    static Pothos::Block* makeTyped(const Pothos::DType &dtype, size_t bits)
     {
-        // Set up the topology.
-        this->connect(this, 0, d_multiply_const_ff0, 0);
-        this->connect(d_multiply_const_ff0, 0, d_float_to_short0, 0);
-        this->connect(d_float_to_short0, 0, d_short_to_float0, 0);
-        this->connect(d_short_to_float0, 0, d_multiply_const_ff1, 0);
-        this->connect(d_multiply_const_ff1, 0, this, 0);
-
-        // Add calls.
-        this->registerCall(this, POTHOS_FCN_TUPLE(quantizer, bits));
-        this->registerCall(this, POTHOS_FCN_TUPLE(quantizer, set_bits));
-        this->connect(this, "set_bits", d_bits_constant_source, "setConstant");
+        return new quantizer(dtype, bits);
+    }
 
-        // Set up evaluator blocks.
-        d_bits_eval0.call("setExpression", "pow(2,bits-1)");
-        this->connect(d_bits_constant_source, "constantChanged", d_bits_eval0, "setBits");
-        this->connect(d_bits_eval0, "triggered", d_multiply_const_ff0, "set_k");
+    quantizer(const Pothos::DType &dtype, size_t bits):
+        Pothos::Block(),
+        d_bits(bits),
+        d_quantizer(bits),
+        d_floats_per_element(dtype.isComplex()? 2 : 1)
+    {
+        if (not dtype.isFloat() or dtype.elemSize() != d_floats_per_element*sizeof(float))
+        {
+            throw Pothos::InvalidArgumentException("quantizer: unsupported dtype", dtype.name());
+        }
 
-        d_bits_eval1.call("setExpression", "1/pow(2,bits-1)");
-        this->connect(d_bits_constant_source, "constantChanged", d_bits_eval1, "setBits");
-        this->connect(d_bits_eval1, "triggered", d_multiply_const_ff1, "set_k");
+        this->setupInput(0, dtype);
+        this->setupOutput(0, dtype);
 
-        d_bits_constant_source.call("setConstant", bits);
+        this->registerCall(this, POTHOS_FCN_TUPLE(quantizer, bits));
+        this->registerCall(this, POTHOS_FCN_TUPLE(quantizer, set_bits));
+        this->registerProbe("bits", "bits_triggered", "probe_bits");
     }
 
     size_t bits() const
     {
-        return d_bits_constant_source.call("getConstant");
+        return d_bits;
+    }
+
+    void set_bits(size_t bits)
+    {
+        d_bits = bits;
+        d_quantizer.setBits(bits);
     }
 
-    // This is needed to connect to internal blocks.
-    void set_bits(size_t) {}
+    void work(void)
+    {
+        const size_t num = this->workInfo().minElements;
+        if (num == 0) return;
 
-private:
-    Pothos::Proxy d_short_to_float0;
-    Pothos::Proxy d_float_to_short0;
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        const auto in = inPort->buffer().as<const float *>();
+        const auto out = outPort->buffer().as<float *>();
 
-    // These were vff for no reason.
-    Pothos::Proxy d_multiply_const_ff0;
-    Pothos::Proxy d_multiply_const_ff1;
+        const size_t dimension = inPort->dtype().dimension();
+        d_quantizer.apply(in, out, num*dimension*d_floats_per_element);
+
+        inPort->consume(num);
+        outPort->produce(num);
+    }
 
-    Pothos::Proxy d_triggered_signal;
-    Pothos::Proxy d_bits_constant_source;
-    Pothos::Proxy d_bits_eval0;
-    Pothos::Proxy d_bits_eval1;
+private:
+    size_t d_bits;
+    Quantizer d_quantizer;
+    size_t d_floats_per_element;
 };
 
 /***********************************************************************
  * |PothosDoc Quantizer
  *
+ * Quantize float samples to the given number of bits.
+ * See Typed Quantizer for complex samples.
+ *
  * |category /GNURadio/Digital
  * |keywords rf bits
  *
@@ -115,8 +119,59 @@ private:
  * |preview enable
  *
  * |factory /gr/channels/quantizer(bits)
- * |initializer set_bits(bits)
+ * |setter set_bits(bits)
  **********************************************************************/
-static Pothos::BlockRegistry registerPhaseBal(
+static Pothos::BlockRegistry registerQuantizer(
     "/gr/channels/quantizer",
     Pothos::Callable(&quantizer::make));
+
+/***********************************************************************
+ * |PothosDoc Typed Quantizer
+ *
+ * Quantize float or complex samples to the given number of bits.
+ * Complex samples are quantized per component.
+ *
+ * |category /GNURadio/Digital
+ * |keywords rf bits complex
+ *
+ * |param dtype[Data Type] The sample type of the input and output.
+ * |widget DTypeChooser(float32=1,cfloat32=1,dim=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param bits[Bits] The number of bits to compress the signal into
+ * |widget SpinBox(minimum=2,maximum=16)
+ * |default 16
+ * |preview enable
+ *
+ * |factory /gr/channels/quantizer_typed(dtype, bits)
+ * |setter set_bits(bits)
+ **********************************************************************/
+static Pothos::BlockRegistry registerQuantizerTyped(
+    "/gr/channels/quantizer_typed",
+    Pothos::Callable(&quantizer::makeTyped));
+
+/***********************************************************************
+ * Known answers: scale by 2^(bits-1), saturate to int16, round half to
+ * even like float_to_short, and scale back
+ **********************************************************************/
+POTHOS_TEST_BLOCK("/gnuradio/tests", test_quantizer_known_answers)
+{
+    const std::vector<float> input{0.3f, -0.7f, 0.126f, 0.999f, -1.2f, 0.125f, 0.375f};
+
+    auto quantizer3 = Pothos::BlockRegistry::make("/gr/channels/quantizer", size_t(3));
+    testChannelClose(std::vector<float>{0.25f, -0.75f, 0.25f, 1.0f, -1.25f, 0.0f, 0.5f},
+        runChannelBlock<float>(quantizer3, input), 1e-6f);
+
+    //16 bits saturates at the int16 range
+    auto quantizer16 = Pothos::BlockRegistry::make("/gr/channels/quantizer", size_t(16));
+    testChannelClose(std::vector<float>{
+        0.2999878f, -0.7000122f, 0.1260071f, 0.9989929f, -1.0f, 0.125f, 0.375f},
+        runChannelBlock<float>(quantizer16, input), 1e-6f);
+
+    //complex samples are quantized per component
+    auto quantizerComplex = Pothos::BlockRegistry::make("/gr/channels/quantizer_typed", "complex_float32", size_t(3));
+    testChannelClose(std::vector<gr_complex>{gr_complex(0.25f, -0.75f), gr_complex(0.0f, 0.5f)},
+        runChannelBlock<gr_complex>(quantizerComplex, std::vector<gr_complex>{
+            gr_complex(0.3f, -0.7f), gr_complex(0.125f, 0.375f)}), 1e-6f);
+}
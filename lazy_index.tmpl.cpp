@@ -0,0 +1,77 @@
+//this is a machine generated file...
+
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/System.hpp>
+#include <Poco/SharedLibrary.h>
+#include <mutex>
+
+/***********************************************************************
+ * load the factories module on first use
+ *
+ * This module does not link against gnuradio. The block paths and docs
+ * are registered at load time, and the first block made from any of
+ * them loads ${module} and forwards to its factories.
+ **********************************************************************/
+static Pothos::Object callLazyFactory(const std::string &path, const Pothos::Object *args, const size_t numArgs)
+{
+    static std::once_flag loaded;
+    static Pothos::PluginModule module;
+
+    //a failed load throws and is retried by the next call
+    std::call_once(loaded, []{
+        const auto modulePath = Pothos::System::getRootPath()+"/${module}"+Poco::SharedLibrary::suffix();
+        module = Pothos::PluginModule(modulePath);
+    });
+
+    const auto plugin = Pothos::PluginRegistry::get("/gnuradio/lazy/blocks"+path);
+    return plugin.getObject().extract<Pothos::Callable>().opaqueCall(args, numArgs);
+}
+
+/***********************************************************************
+ * factory trampolines
+ **********************************************************************/
+% for registration in registrations:
+<%
+    params = ', '.join(['const Pothos::Object &a%d'%i for i in range(registration.num_factory_args)])
+    args = ', '.join(['a%d'%i for i in range(registration.num_factory_args)])
+%>
+static std::shared_ptr<Pothos::Block> lazy__${registration.name}(${params})
+{
+    % if registration.num_factory_args:
+    const Pothos::Object args[] = {${args}};
+    return callLazyFactory("${registration.path}", args, ${registration.num_factory_args}).extract<std::shared_ptr<Pothos::Block>>();
+    % else:
+    return callLazyFactory("${registration.path}", nullptr, 0).extract<std::shared_ptr<Pothos::Block>>();
+    % endif
+}
+% endfor
+
+/***********************************************************************
+ * register block paths
+ **********************************************************************/
+% for registration in registrations:
+static Pothos::BlockRegistry register__${registration.name}("${registration.path}", Pothos::Callable(&lazy__${registration.name}));
+% endfor
+
+/***********************************************************************
+ * register block descriptions
+ **********************************************************************/
+% if docs_component:
+#include "pothos_block_docs.h"
+
+pothos_static_block(registerGrPothosUtilLazyBlockDocs)
+{
+    registerGrPothosBlockDocs("${docs_component}");
+}
+% else:
+pothos_static_block(registerGrPothosUtilLazyBlockDocs)
+{
+    % for path, blockDesc in blockDescs.items():
+    <%
+    escaped = ''.join([hex(ord(ch)).replace('0x', '\\x') for ch in blockDesc])
+    %>
+    Pothos::PluginRegistry::add("/blocks/docs${path}", std::string("${escaped}"));
+    % endfor
+}
+% endif
@@ -1,8 +1,13 @@
 //this is a machine generated file...
 
 #include <Pothos/Framework.hpp>
-#include <Pothos/Proxy.hpp>
+#include <Pothos/Plugin.hpp>
 #include <gnuradio/block.h>
+#include "pothos_block_factory.h"
+#include <complex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace gr;
 
@@ -17,12 +22,12 @@ using namespace gr;
  * make GrPothosBlock wrapper with a gr::block
  **********************************************************************/
 template <typename BlockType>
-std::shared_ptr<Pothos::Block> makeGrPothosBlock(boost::shared_ptr<BlockType> block, size_t vlen, const Pothos::DType& overrideDType)
+std::shared_ptr<Pothos::Block> makeGrPothosBlock(boost::shared_ptr<BlockType> block, size_t vlen, const Pothos::DType& overrideDType,
+    const std::vector<Pothos::DType> &inputDTypes, const std::vector<Pothos::DType> &outputDTypes, const GrPothosDirectCalls &directCalls)
 {
     auto block_ptr = boost::dynamic_pointer_cast<gr::block>(block);
-    auto env = Pothos::ProxyEnvironment::make("managed");
-    auto registry = env->findProxy("Pothos/BlockRegistry");
-    return registry.call<std::shared_ptr<Pothos::Block>>("/gnuradio/block", block_ptr, vlen, overrideDType);
+    return std::shared_ptr<Pothos::Block>(getGrPothosBlockFactory()(block_ptr, vlen, overrideDType, inputDTypes, outputDTypes,
+        static_cast<void *>(block.get()), &directCalls));
 }
 
 /***********************************************************************
@@ -40,8 +45,24 @@ namespace ${ns} {
 
 std::shared_ptr<Pothos::Block> factory__${factory.name}(${factory.exported_factory_args})
 {
+    static const std::vector<Pothos::DType> __input_dtypes{${', '.join(factory.input_dtypes)}};
+    static const std::vector<Pothos::DType> __output_dtypes{${', '.join(factory.output_dtypes)}};
+    static const GrPothosDirectCalls __direct_calls{
+        % for method in factory.direct_calls:
+<%
+    fcn = '&%s::%s::%s'%(factory.namespace, factory.className, method.name)
+    args = ', '.join(['convertGrPothosArg<GrPothosMethodArg<decltype(%s), %d>::type>(__args[%d])'%(fcn, i, i) for i in range(method.num_args)])
+    invoke = 'static_cast<%s::%s *>(__self)->%s(%s)'%(factory.namespace, factory.className, method.name, args)
+%>\
+        % if method.returns_void:
+        {"${method.name}", {${method.num_args}, [](void *__self, const Pothos::Object *__args) -> Pothos::Object {${invoke}; return Pothos::Object();}, false}},
+        % else:
+        {"${method.name}", {${method.num_args}, [](void *__self, const Pothos::Object *__args) -> Pothos::Object {return Pothos::Object(${invoke});}, ${'true' if method.getter else 'false'}}},
+        % endif
+        % endfor
+    };
     auto __orig_block = ${factory.factory_function_path}(${factory.internal_factory_args});
-    auto __pothos_block = makeGrPothosBlock(__orig_block, ${factory.vlen}, ${factory.dtype});
+    auto __pothos_block = makeGrPothosBlock(__orig_block, ${factory.vlen}, ${factory.dtype}, __input_dtypes, __output_dtypes, __direct_calls);
     auto __orig_block_ref = std::ref(*static_cast<${factory.namespace}::${factory.className} *>(__orig_block.get()));
     % if factory.block_methods:
     % endif
@@ -73,10 +94,15 @@ namespace ${ns} {
 
 std::shared_ptr<Pothos::Block> factory__${factory.name}(${factory.exported_factory_args})
 {
-    % for sub_factory in factory.sub_factories:
-    if (${factory.type_key} == "${sub_factory.name}") return factory__${sub_factory.name}(${sub_factory['internal_factory_args']});
-    % endfor
-
+    typedef std::shared_ptr<Pothos::Block> (*SubFactory)(${factory.sub_factory_params});
+    static const std::unordered_map<std::string, SubFactory> subFactories{
+        % for sub_factory in factory.sub_factories:
+        {"${sub_factory.name}", [](${factory.sub_factory_params}) -> std::shared_ptr<Pothos::Block> {return factory__${sub_factory.name}(${sub_factory['internal_factory_args']});}},
+        % endfor
+    };
+
+    const auto it = subFactories.find(${factory.type_key});
+    if (it != subFactories.end()) return it->second(${factory.sub_factory_args});
     throw Pothos::RuntimeException("${factory.name} unknown type: "+${factory.type_key});
 }
 
@@ -88,9 +114,33 @@ std::shared_ptr<Pothos::Block> factory__${factory.name}(${factory.exported_facto
 /***********************************************************************
  * register block factories
  **********************************************************************/
+% if lazy:
+//lazy mode: the index module registers the block paths,
+//and calls into these factories once this module is loaded
+namespace {
+struct LazyFactoryRegistry
+{
+    LazyFactoryRegistry(const std::string &path, const Pothos::Callable &factory):
+        path("/gnuradio/lazy/blocks"+path)
+    {
+        Pothos::PluginRegistry::add(this->path, factory);
+    }
+    ~LazyFactoryRegistry(void)
+    {
+        Pothos::PluginRegistry::remove(this->path);
+    }
+    const std::string path;
+};
+}
+
+% for registration in registrations:
+static LazyFactoryRegistry register__${registration.name}("${registration.path}", Pothos::Callable(&${registration.namespace}::factory__${registration.name}));
+% endfor
+% else:
 % for registration in registrations:
 static Pothos::BlockRegistry register__${registration.name}("${registration.path}", &${registration.namespace}::factory__${registration.name});
 % endfor
+% endif
 
 /***********************************************************************
  * enum conversions
@@ -113,17 +163,26 @@ ${enum.namespace}${enum.name} string_to_${enum.name}(const std::string &s)
  * register block descriptions and conversions
  **********************************************************************/
 #include <Pothos/Plugin.hpp>
+% if register_docs and docs_component:
+#include "pothos_block_docs.h"
+% endif
 
+% if register_docs or enums:
 pothos_static_block(registerGrPothosUtilBlockDocs)
 {
+    % if register_docs and docs_component:
+    registerGrPothosBlockDocs("${docs_component}");
+    % elif register_docs:
     % for path, blockDesc in blockDescs.items():
     <%
     escaped = ''.join([hex(ord(ch)).replace('0x', '\\x') for ch in blockDesc])
     %>
     Pothos::PluginRegistry::add("/blocks/docs${path}", std::string("${escaped}"));
     % endfor
+    % endif
     % for enum in enums:
     Pothos::PluginRegistry::add("/object/convert/gr_enums/int_to_${enum.namespace.replace('::', '_')}${enum.name}", Pothos::Callable(&int_to_${enum.name}));
     Pothos::PluginRegistry::add("/object/convert/gr_enums/string_to_${enum.namespace.replace('::', '_')}${enum.name}", Pothos::Callable(&string_to_${enum.name}));
     % endfor
 }
+% endif